@@ -0,0 +1,17 @@
+#version 150
+
+layout(location = 0) in vec4 vPos;
+
+// per instance
+layout(location = 1) in mat4 vWorld;
+layout(location = 5) in vec4 vColor;
+
+uniform mat4 VP;
+
+out vec4 color;
+
+void main()
+{
+  gl_Position = VP * (vWorld * vPos);
+  color = vColor;
+}
\ No newline at end of file
@@ -1,13 +1,20 @@
 #include "Application.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
 #include <iostream>
+#include <thread>
 
 
 std::vector<UserInputController*> Application::s_inputController;
 
 
 Application::Application(int w, int h, int glMajor, int glMinor, double physicsTimeStep)
-  : m_wnd(0),m_time(0.0), m_physicsTimeStep(physicsTimeStep)
+  : m_wnd(0),m_time(0.0), m_physicsTimeStep(physicsTimeStep), m_physicsThread(false),
+  m_timeWarp(false), m_timeWarpFrameTime(1.0 / 60.0),
+  m_maxCatchUpSteps(8), m_catchUpBudget(0.025), m_stepCost(0.0), m_stepAlpha(0.0), m_lastStepTime(0.0)
 {
   // init glfw and create window
   glfwSetErrorCallback(errorCallback);
@@ -51,25 +58,62 @@ Application::~Application()
 
 void Application::exec()
 {
+  if (m_physicsThread)
+  {
+    execThreaded();
+    return;
+  }
+
   m_time = glfwGetTime();
 
   double timeAccum = 0.0;
   double worldTime = 0.0;
 
+  bool vsync = true;
+
   while (!glfwWindowShouldClose(m_wnd))
   {
     double newTime = glfwGetTime();
     double dt = newTime - m_time;
 
-    // update physics with fixed time intervals
-    timeAccum += dt;
+    bool warp = m_timeWarp;
 
-    while (timeAccum >= m_physicsTimeStep)
+    // waiting for vsync would take most of the frame budget in time warp
+    if (vsync == warp)
     {
-      updatePhysics(m_physicsTimeStep);
-      timeAccum -= m_physicsTimeStep;
+      vsync = !warp;
+      glfwSwapInterval(vsync ? 1 : 0);
+    }
+
+    if (warp)
+    {
+      // as many steps as fit into the frame budget
+      do
+      {
+        step();
+        worldTime += m_physicsTimeStep;
+      } while (glfwGetTime() - newTime < m_timeWarpFrameTime);
+
+      timeAccum = 0.0;
+      m_stepAlpha = 1.0;
+    }
+    else
+    {
+      // update physics with fixed time intervals
+      timeAccum += dt;
+
+      int maxSteps = maxCatchUpSteps();
+      for (int i = 0; i < maxSteps && timeAccum >= m_physicsTimeStep; ++i)
+      {
+        step();
+        timeAccum -= m_physicsTimeStep;
+
+        worldTime += m_physicsTimeStep;
+      }
 
-      worldTime += m_physicsTimeStep;
+      // drop what could not be caught up
+      timeAccum = std::fmod(timeAccum, m_physicsTimeStep);
+      m_stepAlpha = timeAccum / m_physicsTimeStep;
     }
     m_time = newTime;
 
@@ -82,6 +126,89 @@ void Application::exec()
 
 
 
+void Application::execThreaded()
+{
+  std::atomic<bool> quit(false);
+
+  // fixed time steps in real time, swapping buffers with vsync no longer holds back physics
+  std::thread physics([this, &quit]()
+  {
+    double time = glfwGetTime();
+    double timeAccum = 0.0;
+
+    while (!quit)
+    {
+      double newTime = glfwGetTime();
+      timeAccum += newTime - time;
+      time = newTime;
+
+      if (m_timeWarp)
+      {
+        // no waiting, the window thread keeps drawing the latest published step
+        step();
+        timeAccum = 0.0;
+        continue;
+      }
+
+      int maxSteps = maxCatchUpSteps();
+      for (int i = 0; i < maxSteps && timeAccum >= m_physicsTimeStep && !quit; ++i)
+      {
+        step();
+        timeAccum -= m_physicsTimeStep;
+      }
+
+      timeAccum = std::fmod(timeAccum, m_physicsTimeStep);
+
+      // wait for next step
+      std::this_thread::sleep_for(std::chrono::duration<double>(m_physicsTimeStep - timeAccum));
+    }
+  });
+
+  m_time = glfwGetTime();
+
+  while (!glfwWindowShouldClose(m_wnd))
+  {
+    double time = glfwGetTime();
+
+    // time since the last step finished, the physics thread is one step ahead of the interpolated state at most
+    m_stepAlpha = m_timeWarp ? 1.0 : std::min(std::max((time - m_lastStepTime) / m_physicsTimeStep, 0.0), 1.0);
+
+    draw(time - m_time);
+
+    glfwSwapBuffers(m_wnd);
+    glfwPollEvents();
+  }
+
+  quit = true;
+  physics.join();
+}
+
+
+void Application::step()
+{
+  double start = glfwGetTime();
+
+  updatePhysics(m_physicsTimeStep);
+
+  double end = glfwGetTime();
+  m_lastStepTime = end;
+
+  // smooth over roughly the last 10 steps
+  double cost = m_stepCost;
+  m_stepCost = cost > 0.0 ? cost + 0.1 * (end - start - cost) : end - start;
+}
+
+int Application::maxCatchUpSteps() const
+{
+  double cost = m_stepCost;
+  if (cost <= 0.0)
+    return m_maxCatchUpSteps;
+
+  int n = static_cast<int>(m_catchUpBudget / cost);
+  return std::min(std::max(n, 1), m_maxCatchUpSteps);
+}
+
+
 void Application::addUserInputController(UserInputController* controller)
 {
   if (controller)
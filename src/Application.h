@@ -5,6 +5,7 @@
 
 #include "UserInputController.h"
 
+#include <atomic>
 #include <vector>
 
 class Application
@@ -17,6 +18,31 @@ public:
   // execute main loop
   virtual void exec();
 
+  // run updatePhysics on its own thread in real time, the window thread only draws.
+  // set before exec, draw must not touch state owned by updatePhysics
+  void physicsThread(bool enable) { m_physicsThread = enable; }
+  bool physicsThread() const { return m_physicsThread; }
+
+  // time warp: step physics as fast as possible instead of in real time and draw once per frameTime of wall time.
+  // can be switched while exec is running
+  void timeWarp(bool enable) { m_timeWarp = enable; }
+  bool timeWarp() const { return m_timeWarp; }
+
+  void timeWarpFrameTime(double frameTime) { m_timeWarpFrameTime = frameTime; }
+  double timeWarpFrameTime() const { return m_timeWarpFrameTime; }
+
+  // catch-up limit: per frame at most maxSteps physics steps and only as many as fit into budget seconds
+  // at the measured step cost. simulated time left over is dropped, so an overloaded simulation runs slower
+  // than real time instead of freezing the window
+  void catchUp(int maxSteps, double budget) { m_maxCatchUpSteps = maxSteps; m_catchUpBudget = budget; }
+
+  // smoothed wall time of one updatePhysics call
+  double stepCost() const { return m_stepCost; }
+
+  // how far the wall clock is past the last physics step in units of the time step, in [0, 1].
+  // valid in draw for interpolating between the last two steps
+  double stepAlpha() const { return m_stepAlpha; }
+
 
   virtual void init() {}
 
@@ -36,6 +62,12 @@ public:
 
 private:
 
+  void execThreaded();
+
+  // updatePhysics with step cost measurement
+  void step();
+  int maxCatchUpSteps() const;
+
   // glfw error callback
   static void errorCallback(int error, const char* description);
 
@@ -54,5 +86,17 @@ private:
 
   double m_time;
   double m_physicsTimeStep;
+
+  bool m_physicsThread;
+
+  std::atomic<bool> m_timeWarp;
+  double m_timeWarpFrameTime;
+
+  int m_maxCatchUpSteps;
+  double m_catchUpBudget;
+  std::atomic<double> m_stepCost;
+
+  double m_stepAlpha;
+  std::atomic<double> m_lastStepTime;
 };
 
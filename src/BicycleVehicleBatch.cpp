@@ -0,0 +1,413 @@
+#include "BicycleVehicleBatch.h"
+
+#include <algorithm>
+#include <iostream>
+
+
+// lateral tire force per unit of axle load and tangent of the slip angle
+static const btScalar corneringStiffness = 10.0f;
+
+// slip angles are computed with at least this forward speed, keeps the explicit update stable when slow
+static const btScalar minSlipSpeed = 3.0f;
+
+
+BicycleVehicleBatch::BicycleVehicleBatch()
+  : m_terrain(0)
+{
+}
+
+BicycleVehicleBatch::~BicycleVehicleBatch()
+{
+}
+
+bool BicycleVehicleBatch::add(btRaycastVehicle* vehicle)
+{
+  Params params = paramsOf(vehicle);
+
+  if (params.numWheels == 0 || params.frontDist + params.rearDist <= 0.0f || params.mass <= 0.0f)
+  {
+    std::cerr << "error: BicycleVehicleBatch: vehicle needs mass, front and rear wheels" << std::endl;
+    return false;
+  }
+
+  if (m_vehicles.empty())
+    m_params = params;
+  else if (!sameParams(params, m_params))
+  {
+    std::cerr << "error: BicycleVehicleBatch: wheel setup of vehicle differs from batch" << std::endl;
+    return false;
+  }
+
+  btRigidBody* body = vehicle->getRigidBody();
+
+  m_vehicles.push_back(vehicle);
+  m_bodies.push_back(body);
+
+  std::vector<btScalar>* arrays[] = { &m_steering, &m_engineForce, &m_brake, &m_active,
+    &m_x, &m_z, &m_headingX, &m_headingZ, &m_forwardVelocity, &m_lateralVelocity, &m_yawRate,
+    &m_groundHeight, &m_normalX, &m_normalY, &m_normalZ };
+
+  for (size_t k = 0; k < sizeof(arrays) / sizeof(arrays[0]); ++k)
+    arrays[k]->push_back(0.0f);
+
+  // initial planar state from chassis, flat ground below it until sampled
+  loadPlanarState(m_vehicles.size() - 1);
+
+  m_groundHeight.back() = body->getWorldTransform().getOrigin().y();
+  m_normalY.back() = 1.0f;
+
+  // chassis is moved by the batch only
+  body->setMassProps(0.0f, btVector3(0.0f, 0.0f, 0.0f));
+  body->setCollisionFlags((body->getCollisionFlags() & ~btCollisionObject::CF_STATIC_OBJECT) | btCollisionObject::CF_KINEMATIC_OBJECT);
+
+  return true;
+}
+
+void BicycleVehicleBatch::remove(btRaycastVehicle* vehicle)
+{
+  std::vector<btRaycastVehicle*>::iterator it = std::find(m_vehicles.begin(), m_vehicles.end(), vehicle);
+  if (it == m_vehicles.end())
+    return;
+
+  size_t i = it - m_vehicles.begin();
+
+  btRigidBody* body = m_bodies[i];
+  body->setCollisionFlags(body->getCollisionFlags() & ~btCollisionObject::CF_KINEMATIC_OBJECT);
+  body->setMassProps(m_params.mass, m_params.inertia);
+
+  // swap with last
+  m_vehicles[i] = m_vehicles.back();
+  m_bodies[i] = m_bodies.back();
+  m_vehicles.pop_back();
+  m_bodies.pop_back();
+
+  std::vector<btScalar>* arrays[] = { &m_steering, &m_engineForce, &m_brake, &m_active,
+    &m_x, &m_z, &m_headingX, &m_headingZ, &m_forwardVelocity, &m_lateralVelocity, &m_yawRate,
+    &m_groundHeight, &m_normalX, &m_normalY, &m_normalZ };
+
+  for (size_t k = 0; k < sizeof(arrays) / sizeof(arrays[0]); ++k)
+  {
+    std::vector<btScalar>& a = *arrays[k];
+    a[i] = a.back();
+    a.pop_back();
+  }
+}
+
+bool BicycleVehicleBatch::contains(btRaycastVehicle* vehicle) const
+{
+  return std::find(m_vehicles.begin(), m_vehicles.end(), vehicle) != m_vehicles.end();
+}
+
+void BicycleVehicleBatch::loadChassis(btRaycastVehicle* vehicle)
+{
+  std::vector<btRaycastVehicle*>::iterator it = std::find(m_vehicles.begin(), m_vehicles.end(), vehicle);
+  if (it != m_vehicles.end())
+    loadPlanarState(it - m_vehicles.begin());
+}
+
+void BicycleVehicleBatch::loadPlanarState(size_t c)
+{
+  const btRigidBody* body = m_bodies[c];
+
+  const btTransform& t = body->getWorldTransform();
+  btVector3 forward = t.getBasis().getColumn(2);
+  forward[1] = 0.0f;
+  forward = forward.fuzzyZero() ? btVector3(0.0f, 0.0f, 1.0f) : forward.normalized();
+
+  btVector3 v = body->getLinearVelocity();
+  btScalar hx = forward.x(), hz = forward.z();
+
+  m_x[c] = t.getOrigin().x();
+  m_z[c] = t.getOrigin().z();
+  m_headingX[c] = hx;
+  m_headingZ[c] = hz;
+  m_forwardVelocity[c] = v.x() * hx + v.z() * hz;
+  m_lateralVelocity[c] = v.x() * hz - v.z() * hx;
+  m_yawRate[c] = body->getAngularVelocity().y();
+}
+
+void BicycleVehicleBatch::storeWheels() const
+{
+  size_t n = m_vehicles.size();
+
+  for (size_t c = 0; c < n; ++c)
+  {
+    btRaycastVehicle* v = m_vehicles[c];
+    const btTransform& t = m_bodies[c]->getWorldTransform();
+
+    for (int i = 0; i < v->getNumWheels(); ++i)
+    {
+      btWheelInfo& w = v->getWheelInfo(i);
+
+      // distance along the suspension from the connection point down to the ground, less the wheel radius
+      btVector3 connection = t * w.m_chassisConnectionPointCS;
+      btVector3 direction = t.getBasis() * w.m_wheelDirectionCS;
+
+      btScalar ground = m_groundHeight[c];
+      if (m_terrain)
+        m_terrain->surfaceHeight(connection.x(), connection.z(), &ground);
+
+      btScalar maxLength = w.getSuspensionRestLength() + w.m_maxSuspensionTravelCm * btScalar(0.01);
+      btScalar length = maxLength;
+      if (direction.y() < -SIMD_EPSILON)
+        length = (ground - connection.y()) / direction.y() - w.m_wheelsRadius;
+
+      w.m_raycastInfo.m_suspensionLength = btMax(btMin(length, maxLength), btScalar(0.0f));
+    }
+  }
+}
+
+BicycleVehicleBatch::Params BicycleVehicleBatch::paramsOf(btRaycastVehicle* vehicle)
+{
+  const btRigidBody* body = vehicle->getRigidBody();
+
+  Params p;
+  p.mass = body->getInvMass() > 0.0f ? 1.0f / body->getInvMass() : 0.0f;
+  p.inertia = body->getLocalInertia();
+  p.numWheels = vehicle->getNumWheels();
+  p.frontDist = 0.0f;
+  p.rearDist = 0.0f;
+  p.friction = 0.0f;
+  p.stiffness = 0.0f;
+  p.contactHeight = 0.0f;
+
+  // average over wheels of each axle
+  int numFront = 0;
+  for (int i = 0; i < p.numWheels; ++i)
+  {
+    const btWheelInfo& w = vehicle->getWheelInfo(i);
+
+    if (w.m_bIsFrontWheel)
+    {
+      p.frontDist += w.m_chassisConnectionPointCS.z();
+      ++numFront;
+    }
+    else
+      p.rearDist -= w.m_chassisConnectionPointCS.z();
+
+    p.friction += w.m_frictionSlip;
+    p.stiffness += w.m_suspensionStiffness;
+    p.contactHeight += (w.m_chassisConnectionPointCS + w.m_wheelDirectionCS * (w.getSuspensionRestLength() + w.m_wheelsRadius)).y();
+  }
+
+  if (numFront == 0 || numFront == p.numWheels)
+  {
+    // no axle, disables the vehicle in add
+    p.frontDist = p.rearDist = 0.0f;
+    return p;
+  }
+
+  p.frontDist /= numFront;
+  p.rearDist /= p.numWheels - numFront;
+  p.friction /= p.numWheels;
+  p.stiffness /= p.numWheels;
+  p.contactHeight /= p.numWheels;
+
+  return p;
+}
+
+bool BicycleVehicleBatch::sameParams(const Params& a, const Params& b)
+{
+  return a.mass == b.mass && a.inertia == b.inertia && a.frontDist == b.frontDist && a.rearDist == b.rearDist &&
+    a.friction == b.friction && a.stiffness == b.stiffness && a.contactHeight == b.contactHeight && a.numWheels == b.numWheels;
+}
+
+
+void BicycleVehicleBatch::updateAction(btCollisionWorld* world, btScalar step)
+{
+  if (m_vehicles.empty())
+    return;
+
+  // actions are only run by dynamics worlds
+  btScalar gravity = -static_cast<btDynamicsWorld*>(world)->getGravity().y();
+
+  gather();
+  sampleGround();
+  updateModel(step, gravity);
+  scatter(gravity);
+}
+
+void BicycleVehicleBatch::gather()
+{
+  size_t n = m_vehicles.size();
+
+  for (size_t c = 0; c < n; ++c)
+  {
+    const btRaycastVehicle* v = m_vehicles[c];
+
+    btScalar steering = 0.0f, engineForce = 0.0f, brake = 0.0f;
+    int numFront = 0;
+
+    for (int i = 0; i < v->getNumWheels(); ++i)
+    {
+      const btWheelInfo& w = v->getWheelInfo(i);
+
+      if (w.m_bIsFrontWheel)
+      {
+        steering += w.m_steering;
+        ++numFront;
+      }
+
+      engineForce += w.m_engineForce;
+      brake += w.m_brake;
+    }
+
+    m_steering[c] = steering / numFront;
+    m_engineForce[c] = engineForce;
+    m_brake[c] = brake;
+
+    // dead vehicles are frozen by the simulation
+    m_active[c] = m_bodies[c]->getActivationState() != DISABLE_SIMULATION ? 1.0f : 0.0f;
+  }
+}
+
+void BicycleVehicleBatch::sampleGround()
+{
+  if (!m_terrain)
+    return;
+
+  size_t n = m_vehicles.size();
+
+  for (size_t c = 0; c < n; ++c)
+  {
+    // outside of the terrain the last height and normal are kept
+    btScalar height;
+    btVector3 normal;
+    if (m_terrain->surfaceHeight(m_x[c], m_z[c], &height, &normal))
+    {
+      m_groundHeight[c] = height;
+      m_normalX[c] = normal.x();
+      m_normalY[c] = normal.y();
+      m_normalZ[c] = normal.z();
+    }
+  }
+}
+
+void BicycleVehicleBatch::updateModel(btScalar step, btScalar gravity)
+{
+  int n = static_cast<int>(m_vehicles.size());
+
+  const Params& p = m_params;
+
+  btScalar invMass = 1.0f / p.mass;
+  btScalar invYawInertia = 1.0f / p.inertia.y();
+  btScalar wheelBase = p.frontDist + p.rearDist;
+
+  // static axle loads and their friction limits
+  btScalar frontLoad = p.mass * gravity * p.rearDist / wheelBase;
+  btScalar rearLoad = p.mass * gravity * p.frontDist / wheelBase;
+
+  btScalar frontStiffness = corneringStiffness * frontLoad;
+  btScalar rearStiffness = corneringStiffness * rearLoad;
+
+  btScalar frontMaxForce = p.friction * frontLoad;
+  btScalar rearMaxForce = p.friction * rearLoad;
+
+  for (int c = 0; c < n; ++c)
+  {
+    btScalar vx = m_forwardVelocity[c];
+    btScalar vy = m_lateralVelocity[c];
+    btScalar r = m_yawRate[c];
+
+    btScalar sh = m_headingX[c];
+    btScalar ch = m_headingZ[c];
+
+    // heading projected on the ground plane, left = normal x forward
+    btScalar nx = m_normalX[c], ny = m_normalY[c], nz = m_normalZ[c];
+    btScalar d = sh * nx + ch * nz;
+    btScalar fy = -d * ny;
+    btScalar ly = nz * sh - nx * ch;
+
+    // front tire: velocity in wheel frame and lateral force from slip angle
+    btScalar sd = btSin(m_steering[c]);
+    btScalar cd = btCos(m_steering[c]);
+
+    btScalar frontLat = vy + p.frontDist * r;
+    btScalar frontU = vx * cd + frontLat * sd;
+    btScalar frontW = frontLat * cd - vx * sd;
+
+    btScalar frontForce = -frontStiffness * frontW / btMax(btFabs(frontU), minSlipSpeed);
+    frontForce = btMax(btMin(frontForce, frontMaxForce), -frontMaxForce);
+
+    // rear tire: engine force and lateral force share the friction limit as in btRaycastVehicle
+    btScalar rearW = vy - p.rearDist * r;
+    btScalar rearForce = -rearStiffness * rearW / btMax(btFabs(vx), minSlipSpeed);
+    btScalar driveForce = m_engineForce[c];
+
+    btScalar x = driveForce * 0.5f;
+    btScalar forceSquared = x * x + rearForce * rearForce;
+    btScalar skid = forceSquared > rearMaxForce * rearMaxForce ? rearMaxForce / btSqrt(forceSquared) : 1.0f;
+
+    driveForce *= skid;
+    rearForce *= skid;
+
+    // body frame accelerations including gravity along the slope
+    btScalar ax = (driveForce - frontForce * sd) * invMass + vy * r - gravity * fy;
+    btScalar ay = (frontForce * cd + rearForce) * invMass - vx * r - gravity * ly;
+    btScalar ar = (p.frontDist * frontForce * cd - p.rearDist * rearForce) * invYawInertia;
+
+    vx += ax * step;
+    vy += ay * step;
+    r += ar * step;
+
+    // brakes act when no engine force is applied and never reverse the vehicle
+    btScalar brakeDv = m_engineForce[c] == 0.0f ? m_brake[c] * invMass : 0.0f;
+    vx = vx > 0.0f ? btMax(vx - brakeDv, btScalar(0.0f)) : btMin(vx + brakeDv, btScalar(0.0f));
+
+    // rotate heading by yaw angle of this step, second order and renormalized
+    btScalar angle = r * step;
+    btScalar ca = 1.0f - 0.5f * angle * angle;
+
+    btScalar hx = sh * ca + ch * angle;
+    btScalar hz = ch * ca - sh * angle;
+    btScalar invLen = 1.0f / btSqrt(hx * hx + hz * hz);
+
+    btScalar active = m_active[c];
+
+    m_x[c] += active * (vx * sh + vy * ch) * step;
+    m_z[c] += active * (vx * ch - vy * sh) * step;
+
+    m_headingX[c] = active != 0.0f ? hx * invLen : sh;
+    m_headingZ[c] = active != 0.0f ? hz * invLen : ch;
+    m_forwardVelocity[c] = active != 0.0f ? vx : m_forwardVelocity[c];
+    m_lateralVelocity[c] = active != 0.0f ? vy : m_lateralVelocity[c];
+    m_yawRate[c] = active != 0.0f ? r : m_yawRate[c];
+  }
+}
+
+void BicycleVehicleBatch::scatter(btScalar gravity)
+{
+  size_t n = m_vehicles.size();
+
+  // center of mass above the ground, suspension compressed by the chassis weight
+  btScalar sag = gravity / (m_params.numWheels * m_params.stiffness);
+  btScalar rideHeight = -(m_params.contactHeight + sag);
+
+  for (size_t c = 0; c < n; ++c)
+  {
+    if (m_active[c] == 0.0f)
+      continue;
+
+    btRigidBody* body = m_bodies[c];
+
+    // chassis frame from heading and ground normal
+    btVector3 normal(m_normalX[c], m_normalY[c], m_normalZ[c]);
+    btVector3 heading(m_headingX[c], 0.0f, m_headingZ[c]);
+
+    btVector3 forward = (heading - normal * normal.dot(heading)).normalized();
+    btVector3 left = normal.cross(forward);
+
+    btTransform t;
+    t.getBasis().setValue(
+      left.x(), normal.x(), forward.x(),
+      left.y(), normal.y(), forward.y(),
+      left.z(), normal.z(), forward.z());
+    t.setOrigin(btVector3(m_x[c], m_groundHeight[c], m_z[c]) + normal * rideHeight);
+
+    body->setWorldTransform(t);
+    body->getMotionState()->setWorldTransform(t);
+
+    body->setLinearVelocity(forward * m_forwardVelocity[c] + left * m_lateralVelocity[c]);
+    body->setAngularVelocity(normal * m_yawRate[c]);
+  }
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include <btBulletDynamicsCommon.h>
+
+#include "Heightfield.h"
+
+#include <vector>
+
+
+// Cheap replacement for btRaycastVehicle dynamics: planar bicycle model driving on the terrain heightfield.
+// Both front and both rear wheels are merged into one axle each, lateral tire forces grow with the slip angle
+// up to the friction limit of the axle load. The chassis is made kinematic and placed on the terrain surface
+// every step, so sensors and rendering keep working on the chassis body. BulletInterface takes the chassis out
+// of the collision world, contacts with the track have to be detected on the heightfield.
+// Steering, engine force and brake are read from btRaycastVehicle like for RaycastVehicleBatch.
+// The chassis frame is expected to have +y up and +z forward.
+// Vehicle and model state is kept in structure of arrays layout, the model update is one loop over all vehicles.
+class BicycleVehicleBatch : public btActionInterface
+{
+public:
+
+  BicycleVehicleBatch();
+  virtual ~BicycleVehicleBatch();
+
+
+  // take over simulation of vehicle, it must not be added to the world as action.
+  // returns false if the wheel setup differs from the vehicles already in the batch
+  bool add(btRaycastVehicle* vehicle);
+  void remove(btRaycastVehicle* vehicle);
+
+  bool contains(btRaycastVehicle* vehicle) const;
+
+  // reload planar state after the chassis was moved from outside, vehicles not in the batch are ignored
+  void loadChassis(btRaycastVehicle* vehicle);
+
+  // set btWheelInfo suspension lengths of all vehicles from the ground below their wheels, for drawing.
+  // the model itself has no per wheel suspension
+  void storeWheels() const;
+
+  int size() const { return static_cast<int>(m_vehicles.size()); }
+
+  // ground to drive on, without terrain vehicles keep their height
+  void setTerrain(const Heightfield* terrain) { m_terrain = terrain; }
+
+
+  virtual void updateAction(btCollisionWorld* world, btScalar step);
+
+  virtual void debugDraw(btIDebugDraw* drawer) {}
+
+private:
+
+  // model parameters shared by all vehicles, taken from the first one
+  struct Params
+  {
+    btScalar mass;
+    btVector3 inertia;
+    btScalar frontDist;   // distance of front axle to center of mass
+    btScalar rearDist;
+    btScalar friction;    // wheel friction slip
+    btScalar stiffness;   // suspension stiffness, per unit of chassis mass
+    btScalar contactHeight; // wheel contact point in chassis space at suspension rest length
+    int numWheels;
+  };
+
+  static Params paramsOf(btRaycastVehicle* vehicle);
+  static bool sameParams(const Params& a, const Params& b);
+
+  // planar state of vehicle c from its chassis body
+  void loadPlanarState(size_t c);
+
+  void gather();
+  void sampleGround();
+  void updateModel(btScalar step, btScalar gravity);
+  void scatter(btScalar gravity);
+
+private:
+
+  const Heightfield* m_terrain;
+
+  std::vector<btRaycastVehicle*> m_vehicles;
+  std::vector<btRigidBody*> m_bodies;
+
+  Params m_params;
+
+  // controls, summed over wheels
+  std::vector<btScalar> m_steering;
+  std::vector<btScalar> m_engineForce;
+  std::vector<btScalar> m_brake;
+
+  // 1 if chassis is simulated, 0 for disabled bodies
+  std::vector<btScalar> m_active;
+
+  // planar state: ground position, unit heading in the xz plane,
+  // velocity along and to the left of heading and yaw rate
+  std::vector<btScalar> m_x;
+  std::vector<btScalar> m_z;
+  std::vector<btScalar> m_headingX;
+  std::vector<btScalar> m_headingZ;
+  std::vector<btScalar> m_forwardVelocity;
+  std::vector<btScalar> m_lateralVelocity;
+  std::vector<btScalar> m_yawRate;
+
+  // terrain height and normal below the vehicle
+  std::vector<btScalar> m_groundHeight;
+  std::vector<btScalar> m_normalX;
+  std::vector<btScalar> m_normalY;
+  std::vector<btScalar> m_normalZ;
+};
@@ -0,0 +1,137 @@
+#include "BulletArena.h"
+
+#include <LinearMath/btAlignedAllocator.h>
+
+#include <cstdlib>
+#include <mutex>
+
+
+namespace
+{
+  // arena of the current thread
+  thread_local BulletArena* t_arena = 0;
+
+  std::once_flag s_installHooks;
+}
+
+
+BulletArena::BulletArena(size_t chunkSize)
+  : m_chunkSize(chunkSize), m_chunkOffset(chunkSize), m_numBlocksInUse(0), m_released(false)
+{
+  for (int i = 0; i < NumSizeClasses; ++i)
+    m_freeLists[i] = 0;
+
+  // blocks from the default allocator cannot be told apart from ours,
+  // so the hooks must be set before bullet allocates anything
+  std::call_once(s_installHooks, []() { btAlignedAllocSetCustom(bulletAlloc, bulletFree); });
+}
+
+BulletArena::~BulletArena()
+{
+  for (size_t i = 0; i < m_chunks.size(); ++i)
+    std::free(m_chunks[i]);
+}
+
+void BulletArena::release()
+{
+  m_released = true;
+
+  if (!m_numBlocksInUse)
+    delete this;
+}
+
+void* BulletArena::allocate(size_t size)
+{
+  size_t blockSize = sizeof(BlockHeader) + size;
+
+  int sizeClass = 0;
+  while (sizeClass < NumSizeClasses && (size_t(32) << sizeClass) < blockSize)
+    ++sizeClass;
+
+  if (sizeClass == NumSizeClasses)
+    return 0;
+
+  BlockHeader* block = m_freeLists[sizeClass];
+
+  if (block)
+    m_freeLists[sizeClass] = *reinterpret_cast<BlockHeader**>(block + 1);
+  else
+  {
+    blockSize = size_t(32) << sizeClass;
+
+    if (m_chunkOffset + blockSize > m_chunkSize)
+    {
+      char* chunk = static_cast<char*>(std::malloc(m_chunkSize));
+      if (!chunk)
+        return 0;
+
+      m_chunks.push_back(chunk);
+      m_chunkOffset = 0;
+    }
+
+    block = reinterpret_cast<BlockHeader*>(m_chunks.back() + m_chunkOffset);
+    m_chunkOffset += blockSize;
+  }
+
+  block->arena = this;
+  block->sizeClass = sizeClass;
+
+  ++m_numBlocksInUse;
+
+  return block + 1;
+}
+
+void BulletArena::deallocate(BlockHeader* block)
+{
+  // link is stored in the unused block body
+  *reinterpret_cast<BlockHeader**>(block + 1) = m_freeLists[block->sizeClass];
+  m_freeLists[block->sizeClass] = block;
+
+  if (!--m_numBlocksInUse && m_released)
+    delete this;
+}
+
+void* BulletArena::bulletAlloc(size_t size)
+{
+  if (t_arena)
+  {
+    void* ptr = t_arena->allocate(size);
+    if (ptr)
+      return ptr;
+  }
+
+  BlockHeader* block = static_cast<BlockHeader*>(std::malloc(sizeof(BlockHeader) + size));
+  if (!block)
+    return 0;
+
+  block->arena = 0;
+  block->sizeClass = 0;
+
+  return block + 1;
+}
+
+void BulletArena::bulletFree(void* ptr)
+{
+  if (!ptr)
+    return;
+
+  BlockHeader* block = static_cast<BlockHeader*>(ptr) - 1;
+
+  if (block->arena)
+    block->arena->deallocate(block);
+  else
+    std::free(block);
+}
+
+
+
+BulletArena::Scope::Scope(BulletArena* arena)
+  : m_prev(t_arena)
+{
+  t_arena = arena;
+}
+
+BulletArena::Scope::~Scope()
+{
+  t_arena = m_prev;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+
+// Memory arena for the bullet objects of one world.
+// Installs itself as bullet allocator (btAlignedAllocSetCustom), the hooks are process wide,
+// so allocations go to the arena of the calling thread set by BulletArena::Scope and to the heap outside of any scope.
+// Blocks are carved from large chunks and recycled in power of two size classes, freeing a block is a push to a free list.
+// Every block remembers its arena, so it can be freed from anywhere.
+// The chunks are returned to the heap at once when the arena is released and the last block is freed.
+// An arena must only be used by one thread at a time.
+class BulletArena
+{
+public:
+
+  BulletArena(size_t chunkSize = 1 << 20);
+
+  // give up ownership, the arena is deleted as soon as no block is in use
+  void release();
+
+
+  // route bullet allocations of the calling thread to arena until end of scope, 0 selects the heap
+  class Scope
+  {
+  public:
+    Scope(BulletArena* arena);
+    ~Scope();
+
+  private:
+    BulletArena* m_prev;
+  };
+
+
+  size_t numChunks() const { return m_chunks.size(); }
+  size_t numBlocksInUse() const { return m_numBlocksInUse; }
+
+private:
+
+  // prefix of each block handed to bullet
+  struct BlockHeader
+  {
+    BulletArena* arena; // 0 for blocks from the heap
+    size_t sizeClass;
+  };
+
+  // block sizes 32 << k up to 64kb, larger requests go to the heap.
+  // free blocks hold the free list link behind the header, so the smallest block is header plus pointer
+  static const int NumSizeClasses = 12;
+
+  ~BulletArena();
+
+  void* allocate(size_t size);
+  void deallocate(BlockHeader* block);
+
+  static void* bulletAlloc(size_t size);
+  static void bulletFree(void* ptr);
+
+private:
+
+  size_t m_chunkSize;
+  std::vector<char*> m_chunks;
+  size_t m_chunkOffset; // bump pointer in last chunk
+
+  BlockHeader* m_freeLists[NumSizeClasses];
+
+  size_t m_numBlocksInUse;
+  bool m_released;
+};
@@ -2,23 +2,49 @@
 #include <glad/glad.h>
 
 #include "BulletInterface.h"
+#include "StaticSetBroadphase.h"
 
-BulletInterface::BulletInterface()
-  : broadphase(0), collisionConfiguration(0),
-  dispatcher(0), solver(0), world(0)
+#include <algorithm>
+
+BulletInterface::BulletInterface(bool staticSetBroadphase, VehicleDynamics dynamics, int numBodies)
+  : arena(0), broadphase(0), collisionConfiguration(0),
+  dispatcher(0), solver(0), world(0), vehicleDynamics(dynamics), vehicleBatch(0), bicycleBatch(0),
+  terrainBody(0), terrain(0)
 {
-  broadphase = new btDbvtBroadphase();
+  arena = new BulletArena();
+  BulletArena::Scope scope(arena);
+
+  if (staticSetBroadphase)
+    broadphase = new StaticSetBroadphase();
+  else
+    broadphase = new btDbvtBroadphase();
+
+  // one manifold and a few algorithms per body touching the ground, pools fall back to the arena when exhausted
+  btDefaultCollisionConstructionInfo collisionInfo;
+  if (numBodies > 0)
+  {
+    collisionInfo.m_defaultMaxPersistentManifoldPoolSize = numBodies + 64;
+    collisionInfo.m_defaultMaxCollisionAlgorithmPoolSize = 2 * numBodies + 64;
+  }
 
-  collisionConfiguration = new btDefaultCollisionConfiguration();
+  collisionConfiguration = new btDefaultCollisionConfiguration(collisionInfo);
   dispatcher = new btCollisionDispatcher(collisionConfiguration);
 
   solver = new btSequentialImpulseConstraintSolver;
 
   world = new btDiscreteDynamicsWorld(dispatcher, broadphase, solver, collisionConfiguration);
+
+  // batches are empty unless their backend is selected
+  vehicleBatch = new RaycastVehicleBatch();
+  world->addAction(vehicleBatch);
+
+  bicycleBatch = new BicycleVehicleBatch();
+  world->addAction(bicycleBatch);
 }
 
 BulletInterface::~BulletInterface()
 {
+  // blocks return to their arena on free, no scope needed
   for (size_t i = 0; i < rigidBodies.size(); ++i)
   {
     btRigidBody* body = rigidBodies[i];
@@ -31,12 +57,20 @@ BulletInterface::~BulletInterface()
   rigidBodies.clear();
   collisionShapes.clear();
 
+  world->removeAction(vehicleBatch);
+  delete vehicleBatch;
+
+  world->removeAction(bicycleBatch);
+  delete bicycleBatch;
 
   delete world;
   delete solver;
   delete collisionConfiguration;
   delete dispatcher;
   delete broadphase;
+
+  // chunks go back to the heap at once, bodies still held by the caller keep the arena alive until deleted
+  arena->release();
 }
 
 btRigidBody* BulletInterface::createManagedRigidBody(std::shared_ptr<btCollisionShape> shape, 
@@ -54,6 +88,8 @@ btRigidBody* BulletInterface::createManagedRigidBody(std::shared_ptr<btCollision
 
 btRigidBody* BulletInterface::createUnmanagedRigidBody(std::shared_ptr<btCollisionShape> shape, btScalar mass, const btVector3& pos, bool computeInertia /*= true*/)
 {
+  BulletArena::Scope scope(arena);
+
   btVector3 inertia(0.0, 0.0, 0.0);
 
   if (computeInertia)
@@ -77,6 +113,8 @@ btRigidBody* BulletInterface::createUnmanagedRigidBody(std::shared_ptr<btCollisi
 
 btRigidBody* BulletInterface::createUnmanagedRigidBody(std::shared_ptr<btCollisionShape> shape, btScalar mass, const btVector3& pos, int group, int mask, bool computeInertia /*= true*/)
 {
+  BulletArena::Scope scope(arena);
+
   btVector3 inertia(0.0, 0.0, 0.0);
 
   if (computeInertia)
@@ -99,16 +137,33 @@ btRigidBody* BulletInterface::createUnmanagedRigidBody(std::shared_ptr<btCollisi
 
 btRaycastVehicle* BulletInterface::createUnmanagedVehicle(std::shared_ptr<btCollisionShape> chassisShape, btScalar mass, const btVector3& pos, int group, int mask)
 {
+  BulletArena::Scope scope(arena);
+
   // create rigid body for chassis
   btRigidBody* chassisBody = createUnmanagedRigidBody(chassisShape, mass, pos, group, mask, true);
 
   // create custom vehicle raycast to fix the collision filter bug
   struct CustomVehicleRaycaster : public btVehicleRaycaster
   {
-    CustomVehicleRaycaster(btDynamicsWorld* world, int group, int mask) : m_dynamicsWorld(world), m_group(group), m_mask(mask) {}
+    CustomVehicleRaycaster(BulletInterface* bullet, int group, int mask) : m_bullet(bullet), m_dynamicsWorld(bullet->world), m_group(group), m_mask(mask) {}
 
     void* castRay(const btVector3& from, const btVector3& to, btVehicleRaycasterResult& result)
     {
+      // fast path: intersect terrain heightfield without broadphase traversal
+      if (m_bullet->terrainOnly())
+      {
+        btScalar fraction;
+        btVector3 normal;
+        if (m_bullet->terrain->rayTest(from, to, &fraction, &normal))
+        {
+          result.m_hitPointInWorld = from.lerp(to, fraction);
+          result.m_hitNormalInWorld = normal;
+          result.m_distFraction = fraction;
+          return (void*)m_bullet->terrainBody;
+        }
+        return 0;
+      }
+
       btCollisionWorld::ClosestRayResultCallback rayCallback(from, to);
 
       rayCallback.m_collisionFilterGroup = m_group;
@@ -132,12 +187,13 @@ btRaycastVehicle* BulletInterface::createUnmanagedVehicle(std::shared_ptr<btColl
       return 0;
     }
 
+    BulletInterface* m_bullet;
     btDynamicsWorld* m_dynamicsWorld;
     int m_group;
     int m_mask;
   };
 
-  btVehicleRaycaster* vehicleRayCaster = new CustomVehicleRaycaster(world, group, mask);
+  btVehicleRaycaster* vehicleRayCaster = new CustomVehicleRaycaster(this, group, mask);
 
   // create vehicle
   btRaycastVehicle::btVehicleTuning tuning;
@@ -146,8 +202,6 @@ btRaycastVehicle* BulletInterface::createUnmanagedVehicle(std::shared_ptr<btColl
   // never deactivate the vehicle
   chassisBody->setActivationState(DISABLE_DEACTIVATION);
 
-  world->addVehicle(vehicle);
-
   // get chassis box size
   btTransform chassisTransform;
   chassisTransform.setIdentity();
@@ -199,9 +253,105 @@ btRaycastVehicle* BulletInterface::createUnmanagedVehicle(std::shared_ptr<btColl
     wheel.m_rollInfluence = 1;
   }
 
+  // batches need the final wheel setup, vehicles they reject become regular actions
+  bool added = false;
+  if (vehicleDynamics == BatchedRaycastVehicles)
+    added = vehicleBatch->add(vehicle, vehicleRayCaster);
+  else if (vehicleDynamics == BicycleVehicles)
+    added = bicycleBatch->add(vehicle);
+
+  if (!added)
+    world->addVehicle(vehicle);
+
+  // bicycle chassis are placed by the batch alone, they pay no broadphase and per-body costs in the world
+  if (added && vehicleDynamics == BicycleVehicles)
+    world->removeRigidBody(vehicle->getRigidBody());
+
   return vehicle;
 }
 
+void BulletInterface::removeVehicle(btRaycastVehicle* vehicle)
+{
+  if (vehicleBatch->contains(vehicle))
+    vehicleBatch->remove(vehicle);
+  else if (bicycleBatch->contains(vehicle))
+    bicycleBatch->remove(vehicle);
+  else
+    world->removeVehicle(vehicle);
+}
+
+void BulletInterface::saveVehicleState(btRaycastVehicle* vehicle, VehicleState* state) const
+{
+  // batched vehicles keep wheel rotation and suspension in the batch
+  vehicleBatch->storeWheels(vehicle);
+
+  const btRigidBody* body = vehicle->getRigidBody();
+
+  state->transform = body->getWorldTransform();
+  state->linearVelocity = body->getLinearVelocity();
+  state->angularVelocity = body->getAngularVelocity();
+  state->activationState = body->getActivationState();
+
+  state->wheels.resize(vehicle->getNumWheels());
+  for (int i = 0; i < vehicle->getNumWheels(); ++i)
+  {
+    const btWheelInfo& wheel = vehicle->getWheelInfo(i);
+    VehicleState::Wheel& w = state->wheels[i];
+
+    w.rotation = wheel.m_rotation;
+    w.deltaRotation = wheel.m_deltaRotation;
+    w.suspensionLength = wheel.m_raycastInfo.m_suspensionLength;
+
+    w.steering = wheel.m_steering;
+    w.engineForce = wheel.m_engineForce;
+    w.brake = wheel.m_brake;
+  }
+}
+
+void BulletInterface::restoreVehicleState(btRaycastVehicle* vehicle, const VehicleState& state)
+{
+  btRigidBody* body = vehicle->getRigidBody();
+
+  body->setWorldTransform(state.transform);
+  body->setInterpolationWorldTransform(state.transform);
+  body->getMotionState()->setWorldTransform(state.transform);
+
+  body->setLinearVelocity(state.linearVelocity);
+  body->setAngularVelocity(state.angularVelocity);
+  body->setInterpolationLinearVelocity(state.linearVelocity);
+  body->setInterpolationAngularVelocity(state.angularVelocity);
+
+  body->clearForces();
+  body->forceActivationState(state.activationState);
+
+  // contact points of the old position would push the chassis back
+  if (body->getBroadphaseHandle())
+  {
+    world->updateSingleAabb(body);
+    world->getBroadphase()->getOverlappingPairCache()->cleanProxyFromPairs(body->getBroadphaseHandle(), dispatcher);
+  }
+
+  int numWheels = std::min(vehicle->getNumWheels(), static_cast<int>(state.wheels.size()));
+  for (int i = 0; i < numWheels; ++i)
+  {
+    btWheelInfo& wheel = vehicle->getWheelInfo(i);
+    const VehicleState::Wheel& w = state.wheels[i];
+
+    wheel.m_rotation = w.rotation;
+    wheel.m_deltaRotation = w.deltaRotation;
+    wheel.m_raycastInfo.m_suspensionLength = w.suspensionLength;
+
+    wheel.m_steering = w.steering;
+    wheel.m_engineForce = w.engineForce;
+    wheel.m_brake = w.brake;
+
+    vehicle->updateWheelTransform(i, true);
+  }
+
+  vehicleBatch->loadWheels(vehicle);
+  bicycleBatch->loadChassis(vehicle);
+}
+
 
 
 
@@ -214,7 +364,7 @@ btRaycastVehicle* BulletInterface::createUnmanagedVehicle(std::shared_ptr<btColl
 
 
 GLDebugDrawer::GLDebugDrawer()
-  : m_debugMode(0), m_program(0)
+  : m_debugMode(0), m_program(0), m_stream(0), m_lines(0), m_numVertices(0)
 {
 
 }
@@ -222,18 +372,32 @@ GLDebugDrawer::GLDebugDrawer()
 
 GLDebugDrawer::~GLDebugDrawer()
 {
+  delete m_stream;
   delete m_program;
 }
 
 void    GLDebugDrawer::drawLine(const btVector3& from, const btVector3& to, const btVector3& color)
 {
-  m_lineBuf.push_back(from.getX());
-  m_lineBuf.push_back(from.getY());
-  m_lineBuf.push_back(from.getZ());
+  if (m_lines && m_numVertices + 2 > BatchSize)
+  {
+    flush();
+    m_lines = reinterpret_cast<float*>(m_stream->map(BatchSize * 12));
+  }
 
-  m_lineBuf.push_back(to.getX());
-  m_lineBuf.push_back(to.getY());
-  m_lineBuf.push_back(to.getZ());
+  if (!m_lines)
+    return;
+
+  float* v = m_lines + m_numVertices * 3;
+
+  v[0] = from.getX();
+  v[1] = from.getY();
+  v[2] = from.getZ();
+
+  v[3] = to.getX();
+  v[4] = to.getY();
+  v[5] = to.getZ();
+
+  m_numVertices += 2;
 }
 
 void    GLDebugDrawer::setDebugMode(int debugMode)
@@ -242,32 +406,49 @@ void    GLDebugDrawer::setDebugMode(int debugMode)
 }
 
 
-void GLDebugDrawer::endDraw()
+void GLDebugDrawer::beginDraw()
 {
   if (!m_program)
   {
     m_program = new GL::Program();
     m_program->linkFromFile("../data/shaders/simple_vs.glsl", "../data/shaders/simple_fs.glsl");
+
+    m_stream = new GL::StreamBuffer();
   }
 
-  if (m_program && m_program->valid())
+  m_numVertices = 0;
+  m_lines = reinterpret_cast<float*>(m_stream->map(BatchSize * 12));
+}
+
+void GLDebugDrawer::endDraw()
+{
+  flush();
+}
+
+void GLDebugDrawer::flush()
+{
+  if (!m_lines)
+    return;
+
+  GLintptr offset = m_stream->unmap(m_numVertices * 12);
+  m_lines = 0;
+
+  if (m_numVertices && m_program->valid())
   {
     m_program->use();
     m_program->setUniform4f("color", glm::vec4(1.0f, 1.0f, 1.0f, 1.0f));
     m_program->setUniformMatrix4f("WVP", m_viewProj);
 
     glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 12, &m_lineBuf[0]);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 12, reinterpret_cast<const void*>(offset));
 
-    GLsizei n = static_cast<GLsizei>(m_lineBuf.size() / 3);
-
-    glPointSize(5.0f);
-    glDrawArrays(GL_POINTS, 0, n);
-    glDrawArrays(GL_LINES, 0, n);
+    glDrawArrays(GL_LINES, 0, m_numVertices);
 
     glDisableVertexAttribArray(0);
   }
+
+  m_stream->unbind();
+  m_numVertices = 0;
 }
 
 void    GLDebugDrawer::draw3dText(const btVector3& location, const char* textString)
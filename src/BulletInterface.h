@@ -3,14 +3,28 @@
 #include <btBulletDynamicsCommon.h>
 #include "UserInputController.h"
 
+#include "BulletArena.h"
 #include "GLObjects.h"
+#include "Heightfield.h"
+#include "RaycastVehicleBatch.h"
+#include "BicycleVehicleBatch.h"
 
 #include <memory>
 #include <vector>
 
 struct BulletInterface
 {
-  BulletInterface();
+  // backend stepping the vehicles of createUnmanagedVehicle
+  enum VehicleDynamics
+  {
+    RaycastVehicles,        // one btRaycastVehicle action per vehicle
+    BatchedRaycastVehicles, // all vehicles in one RaycastVehicleBatch
+    BicycleVehicles         // kinematic bicycle model, see BicycleVehicleBatch. chassis bodies are not in the world
+  };
+
+  // staticSetBroadphase: only test dynamic bodies against static ones, see StaticSetBroadphase
+  // numBodies: expected number of dynamic bodies, sizes the manifold and collision algorithm pools. 0 keeps the bullet defaults
+  BulletInterface(bool staticSetBroadphase = false, VehicleDynamics dynamics = RaycastVehicles, int numBodies = 0);
   virtual ~BulletInterface();
 
   // managed rigid bodies are immediately added to the world and freed on destructor of BulletInterface
@@ -20,6 +34,49 @@ struct BulletInterface
 
   btRaycastVehicle* createUnmanagedVehicle(std::shared_ptr<btCollisionShape> chassisShape, btScalar mass, const btVector3& pos, int group, int mask);
 
+  // remove vehicle from world or vehicle batch, the chassis body stays in the world unless it was a bicycle vehicle
+  void removeVehicle(btRaycastVehicle* vehicle);
+
+
+  // physics state of a vehicle from createUnmanagedVehicle, independent of its backend
+  struct VehicleState
+  {
+    btTransform transform;
+    btVector3 linearVelocity;
+    btVector3 angularVelocity;
+    int activationState;
+
+    struct Wheel
+    {
+      btScalar rotation;
+      btScalar deltaRotation;
+      btScalar suspensionLength;
+
+      // controls
+      btScalar steering;
+      btScalar engineForce;
+      btScalar brake;
+    };
+    std::vector<Wheel> wheels;
+  };
+
+  void saveVehicleState(btRaycastVehicle* vehicle, VehicleState* state) const;
+
+  // batched backends keep wheel state in their own arrays, copy it to btWheelInfo of all their vehicles
+  void storeWheels() const { vehicleBatch->storeWheels(); bicycleBatch->storeWheels(); }
+
+  // put vehicle back into a saved state without creating bullet objects, contacts of the chassis are dropped.
+  // the state may come from another vehicle with the same wheel setup
+  void restoreVehicleState(btRaycastVehicle* vehicle, const VehicleState& state);
+
+  // static terrain body with cpu copy of its heightfield.
+  // vehicle wheel raycasts query the heightfield directly as long as the terrain is the only managed body.
+  void setTerrain(btRigidBody* body, const Heightfield* heightfield) { terrainBody = body; terrain = heightfield; bicycleBatch->setTerrain(heightfield); }
+  bool terrainOnly() const { return terrain && rigidBodies.size() == 1 && rigidBodies[0] == terrainBody; }
+
+
+  // bullet objects created by BulletInterface and allocations while stepping under BulletArena::Scope(arena) live here
+  BulletArena* arena;
 
   btBroadphaseInterface* broadphase;
   btDefaultCollisionConfiguration* collisionConfiguration;
@@ -27,9 +84,17 @@ struct BulletInterface
   btSequentialImpulseConstraintSolver* solver;
   btDiscreteDynamicsWorld* world;
 
+  // applies to vehicles created from now on, existing vehicles keep their backend
+  VehicleDynamics vehicleDynamics;
+  RaycastVehicleBatch* vehicleBatch;
+  BicycleVehicleBatch* bicycleBatch;
+
 
   std::vector<std::shared_ptr<btCollisionShape>> collisionShapes;
   std::vector<btRigidBody*> rigidBodies;
+
+  btRigidBody* terrainBody;
+  const Heightfield* terrain;
 };
 
 
@@ -87,10 +152,19 @@ public:
   void setViewProj(const glm::mat4& viewProj) { m_viewProj = viewProj; }
 
 
-  void beginDraw() { m_lineBuf.clear(); }
+  // lines are written straight into a stream buffer and drawn in batches
+  void beginDraw();
   void endDraw();
 
 
+private:
+
+  // draw lines written so far and unmap
+  void flush();
+
+  // vertices per mapped range
+  static const int BatchSize = 1 << 16;
+
 private:
 
   int m_debugMode;
@@ -100,5 +174,7 @@ private:
   GL::Program* m_program;
 
 
-  std::vector<float> m_lineBuf;
+  GL::StreamBuffer* m_stream;
+  float* m_lines;
+  int m_numVertices;
 };
\ No newline at end of file
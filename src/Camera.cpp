@@ -98,3 +98,45 @@ void Camera::update()
   m_view = glm::lookAt(m_pos, m_pos + m_dir, m_up);
   m_dirty = false;
 }
+
+
+
+Frustum::Frustum(const glm::mat4& viewProj)
+{
+  // rows of the matrix combined as in clip space -w <= x, y, z <= w
+  for (int i = 0; i < 3; ++i)
+  {
+    for (int c = 0; c < 4; ++c)
+    {
+      m_planes[i * 2][c] = viewProj[c][3] + viewProj[c][i];
+      m_planes[i * 2 + 1][c] = viewProj[c][3] - viewProj[c][i];
+    }
+  }
+
+  for (int i = 0; i < 6; ++i)
+    m_planes[i] /= glm::length(glm::vec3(m_planes[i]));
+}
+
+bool Frustum::sphereVisible(const glm::vec3& center, float radius) const
+{
+  for (int i = 0; i < 6; ++i)
+  {
+    if (glm::dot(glm::vec3(m_planes[i]), center) + m_planes[i].w < -radius)
+      return false;
+  }
+  return true;
+}
+
+bool Frustum::boxVisible(const glm::vec3& min, const glm::vec3& max) const
+{
+  for (int i = 0; i < 6; ++i)
+  {
+    // corner furthest along the plane normal
+    glm::vec3 n(m_planes[i]);
+    glm::vec3 p(n.x >= 0.0f ? max.x : min.x, n.y >= 0.0f ? max.y : min.y, n.z >= 0.0f ? max.z : min.z);
+
+    if (glm::dot(n, p) + m_planes[i].w < 0.0f)
+      return false;
+  }
+  return true;
+}
@@ -55,4 +55,23 @@ private:
 
   glm::mat4 m_view;
   glm::mat4 m_proj;
-};
\ No newline at end of file
+};
+
+
+// view volume of a view projection matrix for culling in world space
+class Frustum
+{
+public:
+
+  Frustum(const glm::mat4& viewProj);
+
+
+  // conservative, may report objects near the corners as visible
+  bool sphereVisible(const glm::vec3& center, float radius) const;
+  bool boxVisible(const glm::vec3& min, const glm::vec3& max) const;
+
+private:
+
+  // left, right, bottom, top, near, far with normals pointing inside, normalized
+  glm::vec4 m_planes[6];
+};
@@ -94,18 +94,18 @@ void CameraControllerUser::keyEvent(GLFWwindow* wnd, int key, int scancode, int
 }
 
 
-CameraControllerFollow::CameraControllerFollow(Camera* cam, btRigidBody* body)
-  : CameraController(cam), m_body(body)
+CameraControllerFollow::CameraControllerFollow(Camera* cam)
+  : CameraController(cam), m_hasTarget(false)
 {
-
+  m_target.setIdentity();
 }
 
 void CameraControllerFollow::update(double dt)
 {
-  if (m_body)
+  if (m_hasTarget)
   {
-    const btVector3& pos = m_body->getWorldTransform().getOrigin();
-    const btMatrix3x3& rot = m_body->getWorldTransform().getBasis();
+    const btVector3& pos = m_target.getOrigin();
+    const btMatrix3x3& rot = m_target.getBasis();
 
     glm::vec3 target(pos[0], pos[1], pos[2]);
     glm::vec3 dir(rot[0][2], rot[1][2], rot[2][2]);
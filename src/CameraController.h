@@ -64,20 +64,21 @@ private:
 };
 
 
-// follow cam for rigid bodies
+// follow cam behind a target transform, +z is forward
 class CameraControllerFollow : public CameraController
 {
 public:
-  CameraControllerFollow(Camera* cam, btRigidBody* body);
+  CameraControllerFollow(Camera* cam);
 
   void update(double dt);
 
 
-  btRigidBody* body() const { return m_body; }
-  void body(btRigidBody* b) { m_body = b; }
+  const btTransform& target() const { return m_target; }
+  void target(const btTransform& t) { m_target = t; m_hasTarget = true; }
 
 private:
 
-  btRigidBody* m_body;
+  btTransform m_target;
+  bool m_hasTarget;
 
 };
\ No newline at end of file
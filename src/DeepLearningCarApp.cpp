@@ -19,7 +19,7 @@ public:
     if (key == GLFW_KEY_C && action == GLFW_RELEASE)
     {
       if (dynamic_cast<CameraControllerUser*>(m_app->camController()))
-        m_app->camController(new CameraControllerFollow(m_app->cam(), m_app->simulation()->vehicle(0)->physics()->getRigidBody()));
+        m_app->camController(new CameraControllerFollow(m_app->cam()));
       else
       {
         CameraControllerUser* camControl = new CameraControllerUser(m_app->cam());
@@ -36,7 +36,8 @@ private:
 
 DeepLearningCarApp::DeepLearningCarApp(int w, int h, int glMajor, int glMinor, double physicsTimeStep)
   : Application(w, h, glMajor, glMinor, physicsTimeStep),
-  m_cam(0), m_camControl(0), m_simulation(0), m_renderer(0), m_settings(0)
+  m_cam(0), m_camControl(0), m_simulation(0), m_renderer(0), m_lastDrawTime(0.0), m_lastPublishTime(0.0), m_lastGeneration(-1),
+  m_sharedFrames(0), m_sharedSlots(4), m_viewer(false), m_lastAttachTime(-1.0), m_lastReceiveTime(0.0), m_settings(0)
 {
   m_cam = new Camera();
 
@@ -62,6 +63,7 @@ DeepLearningCarApp::~DeepLearningCarApp()
   delete m_cam;
   delete m_simulation;
   delete m_renderer;
+  delete m_sharedFrames;
   delete m_settings;
 
   TwTerminate();
@@ -89,13 +91,46 @@ void DeepLearningCarApp::init()
   if (m_settings->Get("simulation", "camera", "userCam") == "followCam")
   {
     // use vehicle follow cam
-    camController(new CameraControllerFollow(m_cam, m_simulation->vehicle(0)->physics()->getRigidBody()));
+    camController(new CameraControllerFollow(m_cam));
   }
 
   // -----------------------------------------------------
 
   m_renderer = new Renderer();
 
+  // frame recording, can also be started in the tweak bar
+  FrameCapture::Format captureFormat = m_settings->Get("capture", "format", "png") == "raw" ? FrameCapture::Raw : FrameCapture::Png;
+  m_renderer->captureOutput(m_settings->Get("capture", "path", "../capture"), captureFormat);
+  m_renderer->capture(m_settings->GetBoolean("capture", "enabled", false));
+
+  m_sharedFrames = new SharedFrameRing();
+
+  if (m_viewer)
+  {
+    // the local simulation only provides the track and is never stepped, the world is not drawn
+    m_renderer->simulationThreaded(true);
+    return;
+  }
+
+  // share frames with viewer processes
+  m_sharedName = m_settings->Get("simulation", "sharedMemory", "");
+  m_sharedSlots = m_settings->GetInteger("simulation", "sharedMemorySlots", 4);
+
+  // step simulation on a separate thread
+  bool threaded = m_settings->GetBoolean("simulation", "simulationThread", false);
+  physicsThread(threaded);
+  m_renderer->simulationThreaded(threaded);
+
+  // run simulation faster than real time
+  timeWarp(m_settings->GetBoolean("simulation", "timeWarp", false));
+  timeWarpFrameTime(m_settings->GetReal("simulation", "timeWarpFrameTime", 1.0 / 60.0));
+
+  TwAddVarCB(m_renderer->tweakbar(), "TimeWarp", TW_TYPE_BOOLCPP, setTimeWarpCallback, getTimeWarpCallback, this, "group=Simulation");
+
+  // bounded catch-up when physics steps get too expensive for real time
+  catchUp(m_settings->GetInteger("simulation", "maxCatchUpSteps", 8), m_settings->GetReal("simulation", "catchUpBudget", 0.025));
+
+  TwAddVarCB(m_renderer->tweakbar(), "StepCost", TW_TYPE_DOUBLE, NULL, getStepCostCallback, this, "group=Performance");
 
   m_simulation->initTweakVars(m_renderer->tweakbar());
 }
@@ -107,30 +142,109 @@ void DeepLearningCarApp::draw(double time)
 
   m_renderer->framebufferSize(width, height);
 
-  m_renderer->draw(time, m_simulation, m_cam);
+  // newest simulation step, keeps the previous one if no step was published since the last frame
+  m_frames.acquire();
+  const SimulationFrame& frame = m_frames.front();
+
+  // follow best vehicle
+  CameraControllerFollow* followCam = dynamic_cast<CameraControllerFollow*>(m_camControl);
+  if (followCam && frame.hasFollowTarget)
+    followCam->target(frame.followTransform(static_cast<btScalar>(stepAlpha())));
+
+  // animate camera
+  if (m_camControl)
+    m_camControl->update(time - m_lastDrawTime);
+  m_lastDrawTime = time;
+
+  m_renderer->draw(time, frame, stepAlpha(), m_simulation, m_cam);
 }
 
 void DeepLearningCarApp::updatePhysics(double dt)
 {
-  if (m_simulation)
-    m_simulation->update(dt);
+  if (!m_simulation)
+    return;
 
-  // follow best vehicle
-  CameraControllerFollow* followCam = dynamic_cast<CameraControllerFollow*>(m_camControl);
-  if (followCam)
+  if (m_viewer)
   {
-    Vehicle* best = m_simulation->bestVehicle();
+    receiveFrame();
+    return;
+  }
 
-    if (m_simulation->userVehicle())
-      best = m_simulation->userVehicle();
+  m_simulation->update(dt);
 
-    if (best)
-      followCam->body(best->physics()->getRigidBody());
+  // skip frames the window would never show
+  if (timeWarp())
+  {
+    double time = glfwGetTime();
+    if (time - m_lastPublishTime < timeWarpFrameTime())
+    {
+      m_lastTransforms.clear();
+      return;
+    }
+    m_lastPublishTime = time;
   }
 
-  // animate camera
-  if (m_camControl)
-    m_camControl->update(dt);
+  SimulationFrame& frame = m_frames.back();
+  m_simulation->publishFrame(&frame);
+
+  shareFrame(frame);
+
+  linkPrevious(&frame);
+  m_frames.publish();
+}
+
+void DeepLearningCarApp::linkPrevious(SimulationFrame* frame)
+{
+  // no interpolation across generations, the vehicles are reset in between
+  frame->hasPrevious = frame->hasFollowTarget && frame->generation == m_lastGeneration && m_lastTransforms.size() == frame->boxes.size();
+  frame->prevTransforms.swap(m_lastTransforms);
+  frame->prevFollowTarget = m_lastFollowTarget;
+
+  m_lastTransforms.resize(frame->boxes.size());
+  for (size_t i = 0; i < frame->boxes.size(); ++i)
+    m_lastTransforms[i] = frame->boxes[i].transform;
+  m_lastFollowTarget = frame->followTarget;
+  m_lastGeneration = frame->generation;
+}
+
+void DeepLearningCarApp::shareFrame(const SimulationFrame& frame)
+{
+  if (m_sharedName.empty())
+    return;
+
+  // the frame size is fixed by the population, leave room for growth
+  if (!m_sharedFrames->valid() && !m_sharedFrames->create(m_sharedName, m_sharedSlots, 2 * SharedFrameRing::frameSize(frame)))
+  {
+    m_sharedName.clear();
+    return;
+  }
+
+  m_sharedFrames->write(frame);
+}
+
+void DeepLearningCarApp::receiveFrame()
+{
+  double time = glfwGetTime();
+
+  // attach once the trainer is running and again if it stops sending, it may have been restarted
+  if (!m_sharedFrames->valid() || time - m_lastReceiveTime > 2.0)
+  {
+    if (time - m_lastAttachTime < 1.0)
+      return;
+    m_lastAttachTime = time;
+
+    if (!m_sharedFrames->attach(m_sharedName))
+      return;
+    m_lastReceiveTime = time;
+  }
+
+  SimulationFrame& frame = m_frames.back();
+  if (!m_sharedFrames->read(&frame))
+    return;
+  m_lastReceiveTime = time;
+
+  linkPrevious(&frame);
+  m_frames.publish();
 }
 
 void DeepLearningCarApp::camController(CameraController* camControl)
@@ -141,4 +255,18 @@ void DeepLearningCarApp::camController(CameraController* camControl)
   m_camControl = camControl;
 }
 
+void TW_CALL DeepLearningCarApp::setTimeWarpCallback(const void* value, void* clientData)
+{
+  static_cast<DeepLearningCarApp*>(clientData)->timeWarp(*static_cast<const bool*>(value));
+}
+
+void TW_CALL DeepLearningCarApp::getTimeWarpCallback(void* value, void* clientData)
+{
+  *static_cast<bool*>(value) = static_cast<DeepLearningCarApp*>(clientData)->timeWarp();
+}
 
+void TW_CALL DeepLearningCarApp::getStepCostCallback(void* value, void* clientData)
+{
+  // milliseconds
+  *static_cast<double*>(value) = static_cast<DeepLearningCarApp*>(clientData)->stepCost() * 1000.0;
+}
@@ -8,6 +8,10 @@
 
 #include "Simulation/Simulation.h"
 
+#include "Simulation/SharedFrameRing.h"
+
+#include "TripleBuffer.h"
+
 class DeepLearningCarApp : public Application
 {
 public:
@@ -27,6 +31,25 @@ public:
 
   Camera* cam() { return m_cam; }
 
+  // viewer mode: draw the frames a training process shares under name instead of simulating, set before init
+  void viewer(const std::string& sharedName) { m_viewer = true; m_sharedName = sharedName; }
+
+
+private:
+
+  // prepare frame for interpolation with the previously published one
+  void linkPrevious(SimulationFrame* frame);
+
+  // copy frame to shared memory for viewers
+  void shareFrame(const SimulationFrame& frame);
+
+  // viewer mode: take the newest shared frame
+  void receiveFrame();
+
+  // tweak bar access to the time warp switch
+  static void TW_CALL setTimeWarpCallback(const void* value, void* clientData);
+  static void TW_CALL getTimeWarpCallback(void* value, void* clientData);
+  static void TW_CALL getStepCostCallback(void* value, void* clientData);
 
 private:
 
@@ -38,6 +61,26 @@ private:
   
   Renderer* m_renderer;
 
+  // snapshots from updatePhysics to draw, the renderer only sees the simulation through these
+  TripleBuffer<SimulationFrame> m_frames;
+  double m_lastDrawTime;
+
+  // wall time of last published frame, in time warp only one step per frame is published
+  double m_lastPublishTime;
+
+  // state of the last published step, becomes the previous step of the next frame for interpolation
+  std::vector<btTransform> m_lastTransforms;
+  btTransform m_lastFollowTarget;
+  int m_lastGeneration;
+
+  // frames shared with viewer processes, or received in viewer mode
+  SharedFrameRing* m_sharedFrames;
+  std::string m_sharedName;
+  int m_sharedSlots;
+  bool m_viewer;
+  double m_lastAttachTime;
+  double m_lastReceiveTime;
+
   // application settings
   INIReader* m_settings;
 };
@@ -0,0 +1,160 @@
+#include "DistanceField.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+// 1d squared euclidean distance transform of sampled function f (Felzenszwalb & Huttenlocher)
+static void distanceTransform1D(const double* f, int n, double* d, int* v, double* z)
+{
+  const double inf = 1e20;
+
+  int k = 0;
+  v[0] = 0;
+  z[0] = -inf;
+  z[1] = inf;
+
+  for (int q = 1; q < n; ++q)
+  {
+    double s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2.0 * q - 2.0 * v[k]);
+    while (s <= z[k])
+    {
+      --k;
+      s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2.0 * q - 2.0 * v[k]);
+    }
+    ++k;
+    v[k] = q;
+    z[k] = s;
+    z[k + 1] = inf;
+  }
+
+  k = 0;
+  for (int q = 0; q < n; ++q)
+  {
+    while (z[k + 1] < q)
+      ++k;
+    d[q] = (q - v[k]) * (q - v[k]) + f[v[k]];
+  }
+}
+
+
+DistanceField::DistanceField(const Heightfield* heightfield)
+  : m_heightfield(heightfield),
+  m_width(heightfield->width() - 1), m_length(heightfield->length() - 1),
+  m_freeHeight(0.0f)
+{
+  int w = m_width;
+  int l = m_length;
+
+  // drivable level: lowest vertex
+  m_freeHeight = heightfield->vertexHeight(0, 0);
+  for (int y = 0; y < heightfield->length(); ++y)
+    for (int x = 0; x < heightfield->width(); ++x)
+      m_freeHeight = std::min(m_freeHeight, heightfield->vertexHeight(x, y));
+
+  m_freeHeight += 1e-3f;
+
+  // squared distance in cells to nearest obstacle cell
+  const double inf = 1e20;
+  std::vector<double> grid(w * l, inf);
+
+  for (int y = 0; y < l; ++y)
+  {
+    for (int x = 0; x < w; ++x)
+    {
+      btScalar cellMax = std::max(
+        std::max(heightfield->vertexHeight(x, y), heightfield->vertexHeight(x + 1, y)),
+        std::max(heightfield->vertexHeight(x, y + 1), heightfield->vertexHeight(x + 1, y + 1)));
+
+      if (cellMax > m_freeHeight)
+        grid[y * w + x] = 0.0;
+    }
+  }
+
+  int n = std::max(w, l);
+  std::vector<double> f(n), d(n), z(n + 1);
+  std::vector<int> v(n);
+
+  // columns
+  for (int x = 0; x < w; ++x)
+  {
+    for (int y = 0; y < l; ++y)
+      f[y] = grid[y * w + x];
+    distanceTransform1D(&f[0], l, &d[0], &v[0], &z[0]);
+    for (int y = 0; y < l; ++y)
+      grid[y * w + x] = d[y];
+  }
+
+  // rows
+  for (int y = 0; y < l; ++y)
+  {
+    distanceTransform1D(&grid[y * w], w, &d[0], &v[0], &z[0]);
+    std::copy(d.begin(), d.begin() + w, grid.begin() + y * w);
+  }
+
+  // distance between cell centers minus half diagonal of both cells
+  // is a lower bound for any point of this cell to any point of the obstacle cell
+  btScalar cellSize = std::min(heightfield->cellSize()[0], heightfield->cellSize()[2]);
+
+  m_distance.resize(w * l);
+  for (int i = 0; i < w * l; ++i)
+    m_distance[i] = static_cast<btScalar>(std::max(std::sqrt(grid[i]) - std::sqrt(2.0), 0.0)) * cellSize;
+}
+
+DistanceField::~DistanceField()
+{
+}
+
+btScalar DistanceField::distance(btScalar wx, btScalar wz) const
+{
+  btScalar gx = m_heightfield->gridX(wx);
+  btScalar gy = m_heightfield->gridY(wz);
+
+  if (gx < 0.0f || gy < 0.0f || gx >= m_width || gy >= m_length)
+    return 0.0f;
+
+  return m_distance[static_cast<int>(gy) * m_width + static_cast<int>(gx)];
+}
+
+bool DistanceField::rayTest(const btVector3& from, const btVector3& to, btScalar* fraction, btVector3* normal) const
+{
+  btVector3 dir = to - from;
+  btScalar len = btSqrt(dir[0] * dir[0] + dir[2] * dir[2]);
+
+  // sphere trace while the segment stays above the drivable level
+  btScalar t = 0.0f;
+
+  if (len > SIMD_EPSILON)
+  {
+    while (t < 1.0f)
+    {
+      btVector3 p = from + dir * t;
+
+      btScalar d = distance(p[0], p[2]);
+      if (d <= 0.0f)
+        break;
+
+      btScalar t1 = std::min(t + d / len, btScalar(1.0));
+
+      if (std::min(p[1], from[1] + dir[1] * t1) <= m_freeHeight)
+        break;
+
+      t = t1;
+    }
+  }
+
+  if (t >= 1.0f)
+    return false;
+
+  // exact test of remaining segment
+  btScalar f;
+  btVector3 n;
+  if (!m_heightfield->rayTest(from + dir * t, to, &f, &n))
+    return false;
+
+  *fraction = t + (1.0f - t) * f;
+  if (normal)
+    *normal = n;
+
+  return true;
+}
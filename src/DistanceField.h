@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Heightfield.h"
+
+#include <vector>
+
+
+// 2d distance field over the cells of a heightfield.
+// Cells with all vertices on the lowest level of the heightfield are drivable,
+// everything else (slopes, walls) is an obstacle.
+// Rays above the drivable level are sphere traced through the field and
+// only tested exactly against the heightfield close to obstacles.
+class DistanceField
+{
+public:
+
+  DistanceField(const Heightfield* heightfield);
+  virtual ~DistanceField();
+
+
+  // world space height of drivable cells
+  btScalar freeHeight() const { return m_freeHeight; }
+
+  // conservative distance from world position (x, z) to the nearest obstacle cell,
+  // 0 outside of the grid
+  btScalar distance(btScalar wx, btScalar wz) const;
+
+  // same result as Heightfield::rayTest
+  bool rayTest(const btVector3& from, const btVector3& to, btScalar* fraction, btVector3* normal = 0) const;
+
+  const Heightfield* heightfield() const { return m_heightfield; }
+
+private:
+
+  const Heightfield* m_heightfield;
+
+  // number of cells
+  int m_width;
+  int m_length;
+
+  btScalar m_freeHeight;
+
+  // per cell distance in world units
+  std::vector<btScalar> m_distance;
+};
@@ -0,0 +1,242 @@
+#include "FrameCapture.h"
+
+#include <lodepng.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+
+FrameCapture::FrameCapture(const std::string& path, Format format, int latency)
+  : m_path(path), m_format(format), m_useFences(false), m_next(0),
+  m_numFrames(0), m_numCaptured(0), m_numDropped(0), m_maxQueued(8), m_quit(false),
+  m_rawWidth(0), m_rawHeight(0)
+{
+  m_useFences = GLAD_GL_VERSION_3_2 || GLAD_GL_ARB_sync;
+
+  for (int i = 0; i < std::max(latency, 1); ++i)
+  {
+    Slot* slot = new Slot();
+    slot->size = 0;
+    slot->fence = 0;
+    slot->w = slot->h = 0;
+    slot->pending = false;
+    m_slots.push_back(slot);
+  }
+
+  if (m_format == Raw)
+  {
+    m_raw.open(m_path + ".rgba", std::ios::binary);
+    if (!m_raw)
+      std::cerr << "error: could not open " << m_path << ".rgba" << std::endl;
+  }
+
+  m_worker = std::thread(&FrameCapture::work, this);
+}
+
+FrameCapture::~FrameCapture()
+{
+  // oldest first to keep the frame order
+  for (size_t i = 0; i < m_slots.size(); ++i)
+  {
+    Slot* slot = m_slots[(m_next + i) % m_slots.size()];
+    if (slot->pending)
+      retire(*slot);
+  }
+
+  // worker finishes the queue before quitting
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_quit = true;
+  }
+  m_cond.notify_one();
+  m_worker.join();
+
+  for (size_t i = 0; i < m_slots.size(); ++i)
+    delete m_slots[i];
+  for (size_t i = 0; i < m_free.size(); ++i)
+    delete m_free[i];
+}
+
+void FrameCapture::capture(int w, int h)
+{
+  if (w <= 0 || h <= 0)
+    return;
+
+  // ring is full, the oldest frame had latency frames to finish
+  Slot& slot = *m_slots[m_next];
+  if (slot.pending)
+    retire(slot);
+
+  GLsizeiptr size = static_cast<GLsizeiptr>(w) * h * 4;
+  if (slot.size < size)
+  {
+    slot.pbo.setData(size, 0, GL_STREAM_READ);
+    slot.size = size;
+  }
+
+  // returns immediately, the copy into the buffer runs on the gpu
+  slot.pbo.bind();
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+  slot.pbo.unbind();
+
+  if (m_useFences)
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+  slot.w = w;
+  slot.h = h;
+  slot.pending = true;
+
+  m_next = (m_next + 1) % m_slots.size();
+
+  // copy out finished frames in order without waiting
+  for (size_t i = 0; i + 1 < m_slots.size(); ++i)
+  {
+    Slot& s = *m_slots[(m_next + i) % m_slots.size()];
+    if (!s.pending)
+      continue;
+    if (!ready(s))
+      break;
+    retire(s);
+  }
+}
+
+bool FrameCapture::ready(const Slot& slot) const
+{
+  if (!slot.fence)
+    return false;
+
+  GLenum status = glClientWaitSync(slot.fence, 0, 0);
+  return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+}
+
+void FrameCapture::retire(Slot& slot)
+{
+  if (slot.fence)
+  {
+    glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+    glDeleteSync(slot.fence);
+    slot.fence = 0;
+  }
+  slot.pending = false;
+
+  int index = m_numFrames++;
+
+  Job* job = 0;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // drop frames rather than slowing down the renderer
+    if (m_queue.size() >= m_maxQueued)
+    {
+      ++m_numDropped;
+      return;
+    }
+
+    if (!m_free.empty())
+    {
+      job = m_free.back();
+      m_free.pop_back();
+    }
+  }
+
+  const unsigned char* pixels = slot.pbo.mapBuffer(GL_READ_ONLY);
+  if (!pixels)
+  {
+    slot.pbo.unbind();
+    std::cerr << "error: FrameCapture could not map pixel buffer" << std::endl;
+    if (job)
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_free.push_back(job);
+    }
+    return;
+  }
+
+  if (!job)
+    job = new Job();
+
+  job->index = index;
+  job->w = slot.w;
+  job->h = slot.h;
+  job->pixels.resize(static_cast<size_t>(slot.w) * slot.h * 4);
+  std::memcpy(job->pixels.data(), pixels, job->pixels.size());
+
+  slot.pbo.unmapBuffer();
+  slot.pbo.unbind();
+
+  ++m_numCaptured;
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_queue.push_back(job);
+  }
+  m_cond.notify_one();
+}
+
+void FrameCapture::work()
+{
+  for (;;)
+  {
+    Job* job = 0;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_cond.wait(lock, [this]() { return m_quit || !m_queue.empty(); });
+
+      if (m_queue.empty())
+        return;
+
+      job = m_queue.front();
+      m_queue.pop_front();
+    }
+
+    write(job);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_free.push_back(job);
+  }
+}
+
+void FrameCapture::write(Job* job)
+{
+  int w = job->w, h = job->h;
+  std::vector<unsigned char>& pixels = job->pixels;
+
+  // framebuffer alpha is not meant to be seen
+  for (size_t i = 3; i < pixels.size(); i += 4)
+    pixels[i] = 255;
+
+  if (m_format == Raw)
+  {
+    if (!m_raw)
+      return;
+
+    // a video stream has one size
+    if (!m_rawWidth)
+    {
+      m_rawWidth = w;
+      m_rawHeight = h;
+    }
+    if (w != m_rawWidth || h != m_rawHeight)
+      return;
+
+    m_raw.write(reinterpret_cast<const char*>(pixels.data()), pixels.size());
+    return;
+  }
+
+  // gl rows are bottom up
+  size_t rowSize = static_cast<size_t>(w) * 4;
+  m_rows.resize(pixels.size());
+  for (int y = 0; y < h; ++y)
+    std::memcpy(&m_rows[y * rowSize], &pixels[(h - 1 - y) * rowSize], rowSize);
+
+  std::ostringstream filename;
+  filename << m_path << "_" << std::setw(5) << std::setfill('0') << job->index << ".png";
+
+  unsigned error = lodepng::encode(filename.str(), m_rows, w, h);
+  if (error)
+    std::cerr << "error: could not write " << filename.str() << ": " << lodepng_error_text(error) << std::endl;
+}
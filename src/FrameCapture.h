@@ -0,0 +1,100 @@
+#pragma once
+
+#include "GLObjects.h"
+
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+// Records drawn frames to disk without stalling the renderer.
+// Frames are read back into a ring of pixel pack buffers and copied out a few frames later once the gpu is done,
+// encoding and file output run on a worker thread. Only plain glReadPixels into buffer objects is used,
+// so capturing also works with offscreen and software contexts. Fences are used if available,
+// otherwise a buffer is mapped when the ring wraps around.
+class FrameCapture
+{
+public:
+
+  enum Format
+  {
+    Png, // one file <path>_00000.png per frame
+    Raw  // all frames appended to <path>.rgba as 8 bit rgba, bottom row first,
+         // e.g. ffmpeg -f rawvideo -pix_fmt rgba -s WxH -i <path>.rgba -vf vflip out.mp4
+  };
+
+  // latency: number of frames in flight before a readback is waited for
+  FrameCapture(const std::string& path, Format format, int latency = 3);
+
+  // writes all pending frames
+  virtual ~FrameCapture();
+
+
+  // read back the current read framebuffer, call after drawing and before swapping buffers
+  void capture(int w, int h);
+
+  int numCaptured() const { return m_numCaptured; }
+
+  // frames skipped because the worker fell behind
+  int numDropped() const { return m_numDropped; }
+
+private:
+
+  struct Slot
+  {
+    GL::PixelPackBuffer pbo;
+    GLsizeiptr size;
+    GLsync fence;
+    int w, h;
+    bool pending;
+  };
+
+  struct Job
+  {
+    int index;
+    int w, h;
+    std::vector<unsigned char> pixels;
+  };
+
+  // true if the readback into slot has finished
+  bool ready(const Slot& slot) const;
+
+  // copy pixels of slot to a job for the worker, waits for the readback if necessary
+  void retire(Slot& slot);
+
+  void work();
+  void write(Job* job);
+
+private:
+
+  std::string m_path;
+  Format m_format;
+
+  bool m_useFences;
+
+  std::vector<Slot*> m_slots;
+  size_t m_next;
+
+  int m_numFrames;
+  int m_numCaptured;
+  int m_numDropped;
+
+  // jobs waiting for the worker and jobs to reuse
+  std::deque<Job*> m_queue;
+  std::vector<Job*> m_free;
+  size_t m_maxQueued;
+
+  std::mutex m_mutex;
+  std::condition_variable m_cond;
+  bool m_quit;
+  std::thread m_worker;
+
+  // worker only
+  std::ofstream m_raw;
+  int m_rawWidth, m_rawHeight;
+  std::vector<unsigned char> m_rows;
+};
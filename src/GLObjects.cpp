@@ -83,6 +83,48 @@ void Buffer::unmapBuffer()
   glUnmapBuffer(m_target);
 }
 
+StreamBuffer::StreamBuffer(GLsizeiptr capacity)
+  : m_capacity(capacity), m_allocated(0), m_offset(0), m_mapOffset(0)
+{
+}
+
+unsigned char* StreamBuffer::map(GLsizeiptr size)
+{
+  bind();
+  if (!valid())
+    return 0;
+
+  if (size > m_capacity)
+    m_capacity = size;
+
+  // orphan storage when full, draws in flight keep the old one
+  if (m_allocated < m_capacity || m_offset + size > m_allocated)
+  {
+    glBufferData(GL_ARRAY_BUFFER, m_capacity, 0, GL_STREAM_DRAW);
+    m_allocated = m_capacity;
+    m_offset = 0;
+  }
+
+  m_mapOffset = m_offset;
+
+  GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_FLUSH_EXPLICIT_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+  return reinterpret_cast<unsigned char*>(glMapBufferRange(GL_ARRAY_BUFFER, m_mapOffset, size, access));
+}
+
+GLintptr StreamBuffer::unmap(GLsizeiptr written)
+{
+  bind();
+
+  if (written > 0)
+    glFlushMappedBufferRange(GL_ARRAY_BUFFER, 0, written);
+  glUnmapBuffer(GL_ARRAY_BUFFER);
+
+  // next range starts 16 byte aligned
+  m_offset = m_mapOffset + ((written + 15) & ~static_cast<GLsizeiptr>(15));
+
+  return m_mapOffset;
+}
+
 Shader::Shader(GLenum type)
   : m_type(type), m_id(0)
 {
@@ -193,6 +235,7 @@ bool Program::linkFromMemory(const std::vector<Shader*>& shaders)
 {
   if (m_id)
     glDeleteProgram(m_id);
+  m_uniformLocations.clear();
 
 
   m_id = glCreateProgram();
@@ -241,9 +284,16 @@ void Program::disable()
 
 GLint Program::uniformLocation(const char* name) const
 {
-  if (m_id)
-    return glGetUniformLocation(m_id, name);
-  return -1;
+  if (!m_id)
+    return -1;
+
+  auto it = m_uniformLocations.find(name);
+  if (it != m_uniformLocations.end())
+    return it->second;
+
+  GLint loc = glGetUniformLocation(m_id, name);
+  m_uniformLocations[name] = loc;
+  return loc;
 }
 
 GLint Program::attribLocation(const char* name) const
@@ -258,17 +308,25 @@ GLint Program::attribLocation(const char* name) const
 
 void Program::setUniform4f(const char* name, const glm::vec4& v)
 {
-  GLint loc = uniformLocation(name);
-  if (loc >= 0)
-    glUniform4f(loc, v.x, v.y, v.z, v.w);
+  setUniform4f(uniformLocation(name), v);
 }
 
 
 void Program::setUniformMatrix4f(const char* name, const glm::mat4& v, bool transpose)
 {
-  GLint loc = uniformLocation(name);
+  setUniformMatrix4f(uniformLocation(name), v, transpose);
+}
+
+void Program::setUniform4f(GLint loc, const glm::vec4& v)
+{
   if (loc >= 0)
-    glUniformMatrix4fv(loc, 1, GL_FALSE, (GLfloat*)&v);
+    glUniform4f(loc, v.x, v.y, v.z, v.w);
+}
+
+void Program::setUniformMatrix4f(GLint loc, const glm::mat4& v, bool transpose)
+{
+  if (loc >= 0)
+    glUniformMatrix4fv(loc, 1, transpose ? GL_TRUE : GL_FALSE, (GLfloat*)&v);
 }
 
 Mesh::Mesh(const char* filename)
@@ -311,23 +369,18 @@ Mesh::Mesh(const char* filename)
   scene = 0;
 
 
-  if (m_numVerts)
-  {
-    m_vertexStride = 12;
-    m_vbo = new VertexBuffer();
-    m_vbo->setData(m_numVerts * m_vertexStride, &verts[0]);
-  }
-
-  if (m_numTris)
-  {
-    m_ibo = new IndexBuffer();
-    m_ibo->setData(m_numTris * 12, &tris[0]);
-  }
+  upload(verts.data(), tris.data());
 
 
   //glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 }
 
+Mesh::Mesh(const float* vertices, int numVertices, const int* triangles, int numTriangles)
+  : m_vbo(0), m_ibo(0), m_numVerts(numVertices), m_numTris(numTriangles), m_vertexStride(0)
+{
+  upload(vertices, triangles);
+}
+
 
 Mesh::~Mesh()
 {
@@ -335,6 +388,42 @@ Mesh::~Mesh()
   delete m_ibo;
 }
 
+void Mesh::drawInstanced(int numInstances)
+{
+  if (m_vbo && m_ibo && m_numTris && numInstances > 0)
+  {
+    m_vbo->bind();
+
+    // vertex layout
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 12, 0); // pos
+
+    m_ibo->bind();
+    glDrawElementsInstanced(GL_TRIANGLES, m_numTris * 3, GL_UNSIGNED_INT, 0, numInstances);
+    m_ibo->unbind();
+
+    m_vbo->unbind();
+
+    glDisableVertexAttribArray(0);
+  }
+}
+
+void Mesh::upload(const float* vertices, const int* triangles)
+{
+  if (m_numVerts)
+  {
+    m_vertexStride = 12;
+    m_vbo = new VertexBuffer();
+    m_vbo->setData(m_numVerts * m_vertexStride, vertices);
+  }
+
+  if (m_numTris)
+  {
+    m_ibo = new IndexBuffer();
+    m_ibo->setData(m_numTris * 12, triangles);
+  }
+}
+
 void Mesh::draw()
 {
   if (m_vbo)
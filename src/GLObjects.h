@@ -5,6 +5,7 @@
 #include <glm/glm.hpp>
 
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 
@@ -47,6 +48,32 @@ public:
   virtual ~VertexBuffer() {}
 };
 
+// Vertex buffer for data that is rewritten every frame.
+// Successive writes go to consecutive ranges mapped without synchronization, so the driver never waits for
+// draws still reading earlier ranges. When the end is reached the storage is orphaned and writing restarts at the front.
+class StreamBuffer : public VertexBuffer
+{
+public:
+  StreamBuffer(GLsizeiptr capacity = 1 << 22);
+  virtual ~StreamBuffer() {}
+
+  // map range for up to size bytes and bind the buffer, 0 on failure
+  unsigned char* map(GLsizeiptr size);
+
+  // end writing, only the first written bytes of the range are kept.
+  // returns byte offset of the range in the buffer for glVertexAttribPointer
+  GLintptr unmap(GLsizeiptr written);
+
+private:
+
+  GLsizeiptr m_capacity;
+  GLsizeiptr m_allocated;
+
+  // start of next and of the mapped range
+  GLintptr m_offset;
+  GLintptr m_mapOffset;
+};
+
 class IndexBuffer : public Buffer
 {
 public:
@@ -54,6 +81,14 @@ public:
   virtual ~IndexBuffer() {}
 };
 
+// target of glReadPixels for asynchronous readback
+class PixelPackBuffer : public Buffer
+{
+public:
+  PixelPackBuffer() : Buffer(GL_PIXEL_PACK_BUFFER) {}
+  virtual ~PixelPackBuffer() {}
+};
+
 
 
 class Shader
@@ -107,6 +142,7 @@ public:
   void use();
   void disable();
 
+  // cached after the first query, hot paths should keep the location instead of the name
   GLint uniformLocation(const char* name) const;
   GLint attribLocation(const char* name) const;
 
@@ -115,6 +151,10 @@ public:
   void setUniform4f(const char* name, const glm::vec4& v);
   void setUniformMatrix4f(const char* name, const glm::mat4& v, bool transpose = false);
 
+  // program must be in use, location -1 is ignored
+  void setUniform4f(GLint loc, const glm::vec4& v);
+  void setUniformMatrix4f(GLint loc, const glm::mat4& v, bool transpose = false);
+
 
 
   GLuint id() const { return m_id; }
@@ -123,6 +163,8 @@ public:
 private:
 
   GLuint m_id;
+
+  mutable std::unordered_map<std::string, GLint> m_uniformLocations;
 };
 
 
@@ -131,10 +173,15 @@ class Mesh
 {
 public:
   Mesh(const char* filename);
+  // triangle list with 3 floats per vertex and 3 indices per triangle
+  Mesh(const float* vertices, int numVertices, const int* triangles, int numTriangles);
   virtual ~Mesh();
 
   void draw();
 
+  // per instance attributes have to be set up by the caller
+  void drawInstanced(int numInstances);
+
   int numVertices() const { return m_numVerts; }
   int numTriangles() const { return m_numTris; }
 
@@ -143,6 +190,10 @@ public:
   VertexBuffer* vertexBuffer() const { return m_vbo; }
   IndexBuffer* indexBuffer() const { return m_ibo; }
 
+private:
+
+  void upload(const float* vertices, const int* triangles);
+
 private:
 
   VertexBuffer* m_vbo;
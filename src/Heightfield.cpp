@@ -0,0 +1,351 @@
+#include "Heightfield.h"
+
+#include <algorithm>
+#include <limits>
+#include <cmath>
+
+
+// Moeller-Trumbore segment-triangle intersection, t in [0,1] along dir
+static bool intersectTriangle(const btVector3& a, const btVector3& b, const btVector3& c,
+  const btVector3& from, const btVector3& dir, btScalar* t, btVector3* normal)
+{
+  btVector3 e1 = b - a;
+  btVector3 e2 = c - a;
+
+  btVector3 p = dir.cross(e2);
+  btScalar det = e1.dot(p);
+
+  if (btFabs(det) < SIMD_EPSILON)
+    return false;
+
+  btScalar invDet = btScalar(1.0) / det;
+
+  btVector3 s = from - a;
+  btScalar u = s.dot(p) * invDet;
+  if (u < 0.0f || u > 1.0f)
+    return false;
+
+  btVector3 q = s.cross(e1);
+  btScalar v = dir.dot(q) * invDet;
+  if (v < 0.0f || u + v > 1.0f)
+    return false;
+
+  btScalar d = e2.dot(q) * invDet;
+  if (d < 0.0f || d > 1.0f)
+    return false;
+
+  *t = d;
+
+  if (normal)
+  {
+    // face the ray origin
+    *normal = e1.cross(e2).normalized();
+    if (normal->dot(dir) > 0.0f)
+      *normal = -*normal;
+  }
+
+  return true;
+}
+
+
+Heightfield::Heightfield(const unsigned char* data, int width, int length,
+  btScalar heightScale, btScalar minHeight, btScalar maxHeight,
+  const btVector3& localScaling, const btVector3& position)
+  : m_width(width), m_length(length)
+{
+  // same local frame as btHeightfieldTerrainShape::getVertex
+  btScalar heightOffset = (minHeight + maxHeight) * btScalar(0.5);
+
+  m_origin = position + btVector3(-(width - 1) * btScalar(0.5), -heightOffset, -(length - 1) * btScalar(0.5)) * localScaling;
+  m_cellSize = localScaling;
+  m_invCellSize = btVector3(btScalar(1.0) / localScaling[0], btScalar(1.0) / localScaling[1], btScalar(1.0) / localScaling[2]);
+
+  m_heights.resize(width * length);
+  for (int i = 0; i < width * length; ++i)
+    m_heights[i] = m_origin[1] + data[i] * heightScale * localScaling[1];
+
+  m_origin[1] = 0.0f;
+}
+
+Heightfield::~Heightfield()
+{
+}
+
+btVector3 Heightfield::vertex(int x, int y) const
+{
+  return btVector3(m_origin[0] + x * m_cellSize[0], vertexHeight(x, y), m_origin[2] + y * m_cellSize[2]);
+}
+
+bool Heightfield::surfaceHeight(btScalar wx, btScalar wz, btScalar* height, btVector3* normal) const
+{
+  btScalar gx = gridX(wx);
+  btScalar gy = gridY(wz);
+
+  if (gx < 0.0f || gy < 0.0f || gx > m_width - 1 || gy > m_length - 1)
+    return false;
+
+  int x = std::min(static_cast<int>(gx), m_width - 2);
+  int y = std::min(static_cast<int>(gy), m_length - 2);
+
+  btScalar u = gx - x;
+  btScalar v = gy - y;
+
+  btScalar h00 = vertexHeight(x, y);
+  btScalar h10 = vertexHeight(x + 1, y);
+  btScalar h01 = vertexHeight(x, y + 1);
+  btScalar h11 = vertexHeight(x + 1, y + 1);
+
+  // triangle split along diagonal (x+1,y) - (x,y+1)
+  btScalar dhdu, dhdv;
+  if (u + v <= 1.0f)
+  {
+    dhdu = h10 - h00;
+    dhdv = h01 - h00;
+    *height = h00 + u * dhdu + v * dhdv;
+  }
+  else
+  {
+    dhdu = h11 - h01;
+    dhdv = h11 - h10;
+    *height = h11 + (u - 1.0f) * dhdu + (v - 1.0f) * dhdv;
+  }
+
+  if (normal)
+    *normal = btVector3(-dhdu * m_invCellSize[0], 1.0f, -dhdv * m_invCellSize[2]).normalized();
+
+  return true;
+}
+
+bool Heightfield::rayTestCell(int x, int y, const btVector3& from, const btVector3& dir, btScalar* fraction, btVector3* normal) const
+{
+  btVector3 v00 = vertex(x, y);
+  btVector3 v10 = vertex(x + 1, y);
+  btVector3 v01 = vertex(x, y + 1);
+  btVector3 v11 = vertex(x + 1, y + 1);
+
+  btScalar t0 = 2.0f, t1 = 2.0f;
+  btVector3 n0, n1;
+
+  bool hit0 = intersectTriangle(v00, v01, v10, from, dir, &t0, &n0);
+  bool hit1 = intersectTriangle(v10, v01, v11, from, dir, &t1, &n1);
+
+  if (!hit0 && !hit1)
+    return false;
+
+  *fraction = std::min(t0, t1);
+  if (normal)
+    *normal = t0 <= t1 ? n0 : n1;
+
+  return true;
+}
+
+void Heightfield::buildPyramid()
+{
+  // level 0: height range of each cell
+  Level base;
+  base.width = m_width - 1;
+  base.length = m_length - 1;
+  base.minHeight.resize(base.width * base.length);
+  base.maxHeight.resize(base.width * base.length);
+
+  for (int y = 0; y < base.length; ++y)
+  {
+    for (int x = 0; x < base.width; ++x)
+    {
+      btScalar h00 = vertexHeight(x, y), h10 = vertexHeight(x + 1, y);
+      btScalar h01 = vertexHeight(x, y + 1), h11 = vertexHeight(x + 1, y + 1);
+
+      base.minHeight[y * base.width + x] = std::min(std::min(h00, h10), std::min(h01, h11));
+      base.maxHeight[y * base.width + x] = std::max(std::max(h00, h10), std::max(h01, h11));
+    }
+  }
+
+  m_levels.clear();
+  m_levels.push_back(base);
+
+  // reduce 2x2 blocks until a single node is left
+  while (m_levels.back().width > 1 || m_levels.back().length > 1)
+  {
+    const Level& prev = m_levels.back();
+
+    Level next;
+    next.width = (prev.width + 1) / 2;
+    next.length = (prev.length + 1) / 2;
+    next.minHeight.resize(next.width * next.length);
+    next.maxHeight.resize(next.width * next.length);
+
+    for (int y = 0; y < next.length; ++y)
+    {
+      for (int x = 0; x < next.width; ++x)
+      {
+        btScalar hmin = std::numeric_limits<btScalar>::max();
+        btScalar hmax = -hmin;
+
+        for (int cy = y * 2; cy < std::min(y * 2 + 2, prev.length); ++cy)
+        {
+          for (int cx = x * 2; cx < std::min(x * 2 + 2, prev.width); ++cx)
+          {
+            hmin = std::min(hmin, prev.minHeight[cy * prev.width + cx]);
+            hmax = std::max(hmax, prev.maxHeight[cy * prev.width + cx]);
+          }
+        }
+
+        next.minHeight[y * next.width + x] = hmin;
+        next.maxHeight[y * next.width + x] = hmax;
+      }
+    }
+
+    m_levels.push_back(next);
+  }
+}
+
+bool Heightfield::clipRay(const btVector3& from, const btVector3& to, RaySegment* ray, btScalar* tmin, btScalar* tmax) const
+{
+  // segment in grid space
+  ray->from = from;
+  ray->dir = to - from;
+  ray->gx0 = gridX(from[0]);
+  ray->gy0 = gridY(from[2]);
+  ray->dgx = gridX(to[0]) - ray->gx0;
+  ray->dgy = gridY(to[2]) - ray->gy0;
+
+  // clip to grid rectangle
+  *tmin = 0.0f;
+  *tmax = 1.0f;
+  btScalar lo[2] = { 0.0f, 0.0f };
+  btScalar hi[2] = { static_cast<btScalar>(m_width - 1), static_cast<btScalar>(m_length - 1) };
+  btScalar o[2] = { ray->gx0, ray->gy0 };
+  btScalar d[2] = { ray->dgx, ray->dgy };
+
+  for (int k = 0; k < 2; ++k)
+  {
+    if (btFabs(d[k]) < SIMD_EPSILON)
+    {
+      if (o[k] < lo[k] || o[k] > hi[k])
+        return false;
+    }
+    else
+    {
+      btScalar ta = (lo[k] - o[k]) / d[k];
+      btScalar tb = (hi[k] - o[k]) / d[k];
+      if (ta > tb)
+        std::swap(ta, tb);
+      *tmin = std::max(*tmin, ta);
+      *tmax = std::min(*tmax, tb);
+    }
+  }
+
+  return *tmin <= *tmax;
+}
+
+bool Heightfield::rayTest(const btVector3& from, const btVector3& to, btScalar* fraction, btVector3* normal) const
+{
+  RaySegment ray;
+  btScalar tmin, tmax;
+  if (!clipRay(from, to, &ray, &tmin, &tmax))
+    return false;
+
+  return rayTestLevel(0, tmin, tmax, ray, fraction, normal);
+}
+
+bool Heightfield::rayTestHierarchical(const btVector3& from, const btVector3& to, btScalar* fraction, btVector3* normal) const
+{
+  RaySegment ray;
+  btScalar tmin, tmax;
+  if (!clipRay(from, to, &ray, &tmin, &tmax))
+    return false;
+
+  // start on the level whose nodes are about as large as the covered part of the segment,
+  // short rays go straight to the cells
+  btScalar span = std::max(btFabs(ray.dgx), btFabs(ray.dgy)) * (tmax - tmin);
+
+  int level = 0;
+  while (level + 1 < numLevels() && (2 << level) <= span)
+    ++level;
+
+  return rayTestLevel(level, tmin, tmax, ray, fraction, normal);
+}
+
+bool Heightfield::rayTestLevel(int level, btScalar tmin, btScalar tmax, const RaySegment& ray, btScalar* fraction, btVector3* normal) const
+{
+  // 2d dda over the nodes of one pyramid level (Amanatides & Woo),
+  // nodes whose height range overlaps the segment are refined on the level below.
+  // Level 0 are the grid cells and needs no pyramid.
+  int width = level ? m_levels[level].width : m_width - 1;
+  int length = level ? m_levels[level].length : m_length - 1;
+  const btScalar inf = std::numeric_limits<btScalar>::max();
+
+  btScalar scale = btScalar(1.0) / (1 << level);
+  btScalar dgx = ray.dgx * scale;
+  btScalar dgy = ray.dgy * scale;
+
+  btScalar gx = (ray.gx0 + ray.dgx * tmin) * scale;
+  btScalar gy = (ray.gy0 + ray.dgy * tmin) * scale;
+
+  int x = std::max(std::min(static_cast<int>(gx), width - 1), 0);
+  int y = std::max(std::min(static_cast<int>(gy), length - 1), 0);
+
+  int stepX = dgx > 0.0f ? 1 : -1;
+  int stepY = dgy > 0.0f ? 1 : -1;
+
+  btScalar tDeltaX = btFabs(dgx) < SIMD_EPSILON ? inf : btFabs(btScalar(1.0) / dgx);
+  btScalar tDeltaY = btFabs(dgy) < SIMD_EPSILON ? inf : btFabs(btScalar(1.0) / dgy);
+
+  btScalar tMaxX = tDeltaX == inf ? inf : tmin + ((dgx > 0.0f ? x + 1 : x) - gx) / dgx;
+  btScalar tMaxY = tDeltaY == inf ? inf : tmin + ((dgy > 0.0f ? y + 1 : y) - gy) / dgy;
+
+  btScalar tEnter = tmin;
+
+  while (x >= 0 && y >= 0 && x < width && y < length)
+  {
+    btScalar tExit = std::min(std::min(tMaxX, tMaxY), tmax);
+
+    // skip node if segment passes completely above or below it
+    btScalar ya = ray.from[1] + ray.dir[1] * tEnter;
+    btScalar yb = ray.from[1] + ray.dir[1] * tExit;
+
+    btScalar nodeMin, nodeMax;
+    if (level)
+    {
+      const Level& lvl = m_levels[level];
+      nodeMin = lvl.minHeight[y * width + x];
+      nodeMax = lvl.maxHeight[y * width + x];
+    }
+    else
+    {
+      btScalar h00 = vertexHeight(x, y), h10 = vertexHeight(x + 1, y);
+      btScalar h01 = vertexHeight(x, y + 1), h11 = vertexHeight(x + 1, y + 1);
+      nodeMin = std::min(std::min(h00, h10), std::min(h01, h11));
+      nodeMax = std::max(std::max(h00, h10), std::max(h01, h11));
+    }
+
+    if (std::min(ya, yb) <= nodeMax && std::max(ya, yb) >= nodeMin)
+    {
+      if (level)
+      {
+        if (rayTestLevel(level - 1, tEnter, tExit, ray, fraction, normal))
+          return true;
+      }
+      else if (rayTestCell(x, y, ray.from, ray.dir, fraction, normal))
+        return true;
+    }
+
+    if (tExit >= tmax)
+      break;
+
+    tEnter = tExit;
+
+    if (tMaxX < tMaxY)
+    {
+      x += stepX;
+      tMaxX += tDeltaX;
+    }
+    else
+    {
+      y += stepY;
+      tMaxY += tDeltaY;
+    }
+  }
+
+  return false;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <btBulletDynamicsCommon.h>
+
+#include <vector>
+
+
+// CPU side copy of a btHeightfieldTerrainShape (up axis y, PHY_UCHAR data, no quad edge flip)
+// for direct queries that bypass the collision world.
+// Vertex (x, y) of the grid is at world position
+//   position + ((x - (w-1)/2) * sx, (h(x,y) - (minHeight+maxHeight)/2) * sy, (y - (l-1)/2) * sz)
+// and each cell is split into the triangles (x,y),(x,y+1),(x+1,y) and (x+1,y),(x,y+1),(x+1,y+1),
+// exactly as bullet triangulates the shape.
+// Ray queries walk the grid cell by cell. After buildPyramid, rayTestHierarchical traverses
+// a min/max height pyramid over the cells instead and skips empty regions.
+class Heightfield
+{
+public:
+
+  Heightfield(const unsigned char* data, int width, int length,
+    btScalar heightScale, btScalar minHeight, btScalar maxHeight,
+    const btVector3& localScaling, const btVector3& position);
+  virtual ~Heightfield();
+
+
+  int width() const { return m_width; }
+  int length() const { return m_length; }
+
+  // world space height of grid vertex
+  btScalar vertexHeight(int x, int y) const { return m_heights[y * m_width + x]; }
+  btVector3 vertex(int x, int y) const;
+
+  // world space size of a grid cell in x and z, y is the height scale
+  const btVector3& cellSize() const { return m_cellSize; }
+
+  // continuous grid coordinates of world position (x, z)
+  btScalar gridX(btScalar wx) const { return (wx - m_origin[0]) * m_invCellSize[0]; }
+  btScalar gridY(btScalar wz) const { return (wz - m_origin[2]) * m_invCellSize[2]; }
+
+  // height of the triangulated surface below world position (x, z),
+  // returns false outside of the grid
+  bool surfaceHeight(btScalar wx, btScalar wz, btScalar* height, btVector3* normal = 0) const;
+
+  // closest intersection of segment from-to with the surface (both triangle sides)
+  // fraction: hit position along segment in [0,1]
+  // normal: triangle normal facing the ray origin
+  bool rayTest(const btVector3& from, const btVector3& to, btScalar* fraction, btVector3* normal = 0) const;
+
+  // same result as rayTest, traversing the min/max height pyramid.
+  // Pays off for long rays over open terrain, narrow corridors are faster with rayTest.
+  bool rayTestHierarchical(const btVector3& from, const btVector3& to, btScalar* fraction, btVector3* normal = 0) const;
+
+  // build min/max height pyramid for rayTestHierarchical
+  void buildPyramid();
+
+  // number of pyramid levels, level 0 holds the min/max height of each cell, 0 if not built
+  int numLevels() const { return static_cast<int>(m_levels.size()); }
+
+private:
+
+  // min/max height pyramid, each level halves the resolution
+  struct Level
+  {
+    int width;
+    int length;
+    std::vector<btScalar> minHeight;
+    std::vector<btScalar> maxHeight;
+  };
+
+  // segment in world and grid space
+  struct RaySegment
+  {
+    btVector3 from;
+    btVector3 dir;
+    btScalar gx0, gy0;
+    btScalar dgx, dgy;
+  };
+
+  // segment in grid space clipped to the grid rectangle, false if it misses the grid
+  bool clipRay(const btVector3& from, const btVector3& to, RaySegment* ray, btScalar* tmin, btScalar* tmax) const;
+
+  // walk the nodes of a pyramid level crossed by the segment in [tmin, tmax], front to back
+  bool rayTestLevel(int level, btScalar tmin, btScalar tmax, const RaySegment& ray, btScalar* fraction, btVector3* normal) const;
+
+  // intersect segment with both triangles of cell (x, y)
+  bool rayTestCell(int x, int y, const btVector3& from, const btVector3& dir, btScalar* fraction, btVector3* normal) const;
+
+private:
+
+  int m_width;
+  int m_length;
+
+  // world space heights of grid vertices, row major
+  std::vector<btScalar> m_heights;
+
+  // world space position of vertex (0,0) and cell size
+  btVector3 m_origin;
+  btVector3 m_cellSize;
+  btVector3 m_invCellSize;
+
+  std::vector<Level> m_levels;
+};
@@ -0,0 +1,706 @@
+#include "RaycastVehicleBatch.h"
+
+#include <algorithm>
+#include <iostream>
+
+
+void RaycastVehicleBatch::WheelLane::resize(size_t n)
+{
+  steering.resize(n);
+  engineForce.resize(n);
+  brake.resize(n);
+
+  rotation.resize(n);
+  deltaRotation.resize(n);
+  suspensionLength.resize(n);
+
+  hardPoint.resize(n);
+  direction.resize(n);
+  wheelAxle.resize(n);
+  axle.resize(n);
+  forward.resize(n);
+  position.resize(n);
+  contactPoint.resize(n);
+  contactNormal.resize(n);
+  inContact.resize(n);
+  relativeVelocity.resize(n);
+  clippedInvContactDotSuspension.resize(n);
+  suspensionForce.resize(n);
+  sideImpulse.resize(n);
+  forwardImpulse.resize(n);
+}
+
+void RaycastVehicleBatch::WheelLane::swapRemove(size_t i)
+{
+  // only the persistent state has to survive, the rest is rewritten every step
+  rotation[i] = rotation.back();
+  deltaRotation[i] = deltaRotation.back();
+  suspensionLength[i] = suspensionLength.back();
+
+  resize(rotation.size() - 1);
+}
+
+
+RaycastVehicleBatch::RaycastVehicleBatch()
+  : m_upAxis(1), m_forwardAxis(2)
+{
+}
+
+RaycastVehicleBatch::~RaycastVehicleBatch()
+{
+}
+
+bool RaycastVehicleBatch::add(btRaycastVehicle* vehicle, btVehicleRaycaster* raycaster)
+{
+  int numWheels = vehicle->getNumWheels();
+
+  if (m_vehicles.empty())
+  {
+    m_tuning.clear();
+    for (int k = 0; k < numWheels; ++k)
+      m_tuning.push_back(tuningOf(vehicle->getWheelInfo(k)));
+
+    m_lanes.resize(numWheels);
+    m_upAxis = vehicle->getUpAxis();
+    m_forwardAxis = vehicle->getForwardAxis();
+  }
+  else
+  {
+    bool same = numWheels == static_cast<int>(m_tuning.size()) && vehicle->getUpAxis() == m_upAxis && vehicle->getForwardAxis() == m_forwardAxis;
+
+    for (int k = 0; same && k < numWheels; ++k)
+      same = sameTuning(m_tuning[k], tuningOf(vehicle->getWheelInfo(k)));
+
+    if (!same)
+    {
+      std::cerr << "error: RaycastVehicleBatch: wheel setup of vehicle differs from batch" << std::endl;
+      return false;
+    }
+  }
+
+  size_t n = m_vehicles.size() + 1;
+
+  m_vehicles.push_back(vehicle);
+  m_bodies.push_back(vehicle->getRigidBody());
+  m_raycasters.push_back(raycaster);
+
+  for (int i = 0; i < 9; ++i)
+  {
+    m_basis[i].resize(n);
+    m_invInertiaWorld[i].resize(n);
+  }
+  m_centerOfMass.resize(n);
+  m_linearVelocity.resize(n);
+  m_angularVelocity.resize(n);
+  m_invMass.resize(n);
+  m_invInertiaLocal.resize(n);
+
+  m_relPos.resize(n);
+  m_impulse.resize(n);
+
+  for (int k = 0; k < numWheels; ++k)
+  {
+    const btWheelInfo& wheel = vehicle->getWheelInfo(k);
+    WheelLane& lane = m_lanes[k];
+
+    lane.resize(n);
+    lane.rotation[n - 1] = wheel.m_rotation;
+    lane.deltaRotation[n - 1] = wheel.m_deltaRotation;
+    lane.suspensionLength[n - 1] = wheel.m_raycastInfo.m_suspensionLength;
+  }
+
+  return true;
+}
+
+void RaycastVehicleBatch::remove(btRaycastVehicle* vehicle)
+{
+  std::vector<btRaycastVehicle*>::iterator it = std::find(m_vehicles.begin(), m_vehicles.end(), vehicle);
+  if (it == m_vehicles.end())
+    return;
+
+  size_t i = it - m_vehicles.begin();
+
+  // swap with last, chassis state is gathered again each step
+  m_vehicles[i] = m_vehicles.back();
+  m_bodies[i] = m_bodies.back();
+  m_raycasters[i] = m_raycasters.back();
+
+  m_vehicles.pop_back();
+  m_bodies.pop_back();
+  m_raycasters.pop_back();
+
+  for (size_t k = 0; k < m_lanes.size(); ++k)
+    m_lanes[k].swapRemove(i);
+
+  size_t n = m_vehicles.size();
+
+  for (int j = 0; j < 9; ++j)
+  {
+    m_basis[j].resize(n);
+    m_invInertiaWorld[j].resize(n);
+  }
+  m_centerOfMass.resize(n);
+  m_linearVelocity.resize(n);
+  m_angularVelocity.resize(n);
+  m_invMass.resize(n);
+  m_invInertiaLocal.resize(n);
+
+  m_relPos.resize(n);
+  m_impulse.resize(n);
+}
+
+bool RaycastVehicleBatch::contains(btRaycastVehicle* vehicle) const
+{
+  return std::find(m_vehicles.begin(), m_vehicles.end(), vehicle) != m_vehicles.end();
+}
+
+void RaycastVehicleBatch::storeWheels(btRaycastVehicle* vehicle) const
+{
+  std::vector<btRaycastVehicle*>::const_iterator it = std::find(m_vehicles.begin(), m_vehicles.end(), vehicle);
+  if (it == m_vehicles.end())
+    return;
+
+  storeWheels(it - m_vehicles.begin());
+}
+
+void RaycastVehicleBatch::storeWheels() const
+{
+  for (size_t c = 0; c < m_vehicles.size(); ++c)
+    storeWheels(c);
+}
+
+void RaycastVehicleBatch::storeWheels(size_t c) const
+{
+  btRaycastVehicle* vehicle = m_vehicles[c];
+
+  for (size_t k = 0; k < m_lanes.size(); ++k)
+  {
+    btWheelInfo& wheel = vehicle->getWheelInfo(static_cast<int>(k));
+    wheel.m_rotation = m_lanes[k].rotation[c];
+    wheel.m_deltaRotation = m_lanes[k].deltaRotation[c];
+    wheel.m_raycastInfo.m_suspensionLength = m_lanes[k].suspensionLength[c];
+  }
+}
+
+void RaycastVehicleBatch::loadWheels(btRaycastVehicle* vehicle)
+{
+  std::vector<btRaycastVehicle*>::iterator it = std::find(m_vehicles.begin(), m_vehicles.end(), vehicle);
+  if (it == m_vehicles.end())
+    return;
+
+  size_t c = it - m_vehicles.begin();
+
+  for (size_t k = 0; k < m_lanes.size(); ++k)
+  {
+    const btWheelInfo& wheel = vehicle->getWheelInfo(static_cast<int>(k));
+    m_lanes[k].rotation[c] = wheel.m_rotation;
+    m_lanes[k].deltaRotation[c] = wheel.m_deltaRotation;
+    m_lanes[k].suspensionLength[c] = wheel.m_raycastInfo.m_suspensionLength;
+  }
+}
+
+bool RaycastVehicleBatch::sameTuning(const WheelTuning& a, const WheelTuning& b)
+{
+  return a.connectionCS == b.connectionCS && a.directionCS == b.directionCS && a.axleCS == b.axleCS &&
+    a.restLength == b.restLength && a.radius == b.radius && a.stiffness == b.stiffness &&
+    a.dampingCompression == b.dampingCompression && a.dampingRelaxation == b.dampingRelaxation &&
+    a.frictionSlip == b.frictionSlip && a.maxSuspensionTravelCm == b.maxSuspensionTravelCm &&
+    a.maxSuspensionForce == b.maxSuspensionForce && a.rollInfluence == b.rollInfluence;
+}
+
+RaycastVehicleBatch::WheelTuning RaycastVehicleBatch::tuningOf(const btWheelInfo& wheel)
+{
+  WheelTuning t;
+  t.connectionCS = wheel.m_chassisConnectionPointCS;
+  t.directionCS = wheel.m_wheelDirectionCS;
+  t.axleCS = wheel.m_wheelAxleCS;
+  t.restLength = wheel.getSuspensionRestLength();
+  t.radius = wheel.m_wheelsRadius;
+  t.stiffness = wheel.m_suspensionStiffness;
+  t.dampingCompression = wheel.m_wheelsDampingCompression;
+  t.dampingRelaxation = wheel.m_wheelsDampingRelaxation;
+  t.frictionSlip = wheel.m_frictionSlip;
+  t.maxSuspensionTravelCm = wheel.m_maxSuspensionTravelCm;
+  t.maxSuspensionForce = wheel.m_maxSuspensionForce;
+  t.rollInfluence = wheel.m_rollInfluence;
+  return t;
+}
+
+
+void RaycastVehicleBatch::updateAction(btCollisionWorld* world, btScalar step)
+{
+  if (m_vehicles.empty())
+    return;
+
+  gather();
+  updateWheelTransforms();
+  rayCast();
+  updateSuspension(step);
+  updateFriction(step);
+  updateRotation(step);
+  scatter();
+}
+
+void RaycastVehicleBatch::gather()
+{
+  size_t n = m_vehicles.size();
+
+  for (size_t c = 0; c < n; ++c)
+  {
+    const btRigidBody* body = m_bodies[c];
+    const btTransform& trans = body->getCenterOfMassTransform();
+
+    for (int i = 0; i < 9; ++i)
+    {
+      m_basis[i][c] = trans.getBasis()[i / 3][i % 3];
+      m_invInertiaWorld[i][c] = body->getInvInertiaTensorWorld()[i / 3][i % 3];
+    }
+
+    m_centerOfMass.set(c, trans.getOrigin());
+    m_linearVelocity.set(c, body->getLinearVelocity());
+    m_angularVelocity.set(c, body->getAngularVelocity());
+    m_invMass[c] = body->getInvMass();
+    m_invInertiaLocal.set(c, body->getInvInertiaDiagLocal());
+
+    for (size_t k = 0; k < m_lanes.size(); ++k)
+    {
+      const btWheelInfo& wheel = m_vehicles[c]->getWheelInfo(static_cast<int>(k));
+      m_lanes[k].steering[c] = wheel.m_steering;
+      m_lanes[k].engineForce[c] = wheel.m_engineForce;
+      m_lanes[k].brake[c] = wheel.m_brake;
+    }
+  }
+}
+
+void RaycastVehicleBatch::scatter()
+{
+  size_t n = m_vehicles.size();
+
+  for (size_t c = 0; c < n; ++c)
+  {
+    m_bodies[c]->setLinearVelocity(m_linearVelocity.get(c));
+    m_bodies[c]->setAngularVelocity(m_angularVelocity.get(c));
+  }
+}
+
+void RaycastVehicleBatch::updateWheelTransforms()
+{
+  int n = static_cast<int>(m_vehicles.size());
+
+  const btScalar* b[9];
+  for (int i = 0; i < 9; ++i)
+    b[i] = &m_basis[i][0];
+
+  const btScalar* ox = &m_centerOfMass.x[0];
+  const btScalar* oy = &m_centerOfMass.y[0];
+  const btScalar* oz = &m_centerOfMass.z[0];
+
+  for (size_t k = 0; k < m_lanes.size(); ++k)
+  {
+    const WheelTuning& t = m_tuning[k];
+    WheelLane& lane = m_lanes[k];
+
+    btScalar cx = t.connectionCS.x(), cy = t.connectionCS.y(), cz = t.connectionCS.z();
+    btScalar dx = t.directionCS.x(), dy = t.directionCS.y(), dz = t.directionCS.z();
+    btScalar ax = t.axleCS.x(), ay = t.axleCS.y(), az = t.axleCS.z();
+
+    for (int c = 0; c < n; ++c)
+    {
+      // chassis transform applied to connection point, direction and axle
+      btScalar hx = b[0][c] * cx + b[1][c] * cy + b[2][c] * cz + ox[c];
+      btScalar hy = b[3][c] * cx + b[4][c] * cy + b[5][c] * cz + oy[c];
+      btScalar hz = b[6][c] * cx + b[7][c] * cy + b[8][c] * cz + oz[c];
+
+      btScalar wx = b[0][c] * dx + b[1][c] * dy + b[2][c] * dz;
+      btScalar wy = b[3][c] * dx + b[4][c] * dy + b[5][c] * dz;
+      btScalar wz = b[6][c] * dx + b[7][c] * dy + b[8][c] * dz;
+
+      btScalar rx = b[0][c] * ax + b[1][c] * ay + b[2][c] * az;
+      btScalar ry = b[3][c] * ax + b[4][c] * ay + b[5][c] * az;
+      btScalar rz = b[6][c] * ax + b[7][c] * ay + b[8][c] * az;
+
+      lane.hardPoint.x[c] = hx;
+      lane.hardPoint.y[c] = hy;
+      lane.hardPoint.z[c] = hz;
+
+      lane.direction.x[c] = wx;
+      lane.direction.y[c] = wy;
+      lane.direction.z[c] = wz;
+
+      // wheel center uses the suspension length of the last step
+      btScalar len = lane.suspensionLength[c];
+      lane.position.x[c] = hx + wx * len;
+      lane.position.y[c] = hy + wy * len;
+      lane.position.z[c] = hz + wz * len;
+
+      // rotate axle around up = -direction by the steering angle,
+      // the wheel rotation around the axle leaves the axle unchanged
+      btScalar s = btSin(lane.steering[c]);
+      btScalar co = btCos(lane.steering[c]);
+
+      btScalar ux = -wx, uy = -wy, uz = -wz;
+      btScalar ud = ux * rx + uy * ry + uz * rz;
+
+      lane.wheelAxle.x[c] = rx * co + (uy * rz - uz * ry) * s + ux * ud * (1 - co);
+      lane.wheelAxle.y[c] = ry * co + (uz * rx - ux * rz) * s + uy * ud * (1 - co);
+      lane.wheelAxle.z[c] = rz * co + (ux * ry - uy * rx) * s + uz * ud * (1 - co);
+    }
+  }
+}
+
+void RaycastVehicleBatch::rayCast()
+{
+  int n = static_cast<int>(m_vehicles.size());
+
+  for (size_t k = 0; k < m_lanes.size(); ++k)
+  {
+    const WheelTuning& t = m_tuning[k];
+    WheelLane& lane = m_lanes[k];
+
+    btScalar rayLength = t.restLength + t.radius;
+    btScalar minLength = t.restLength - t.maxSuspensionTravelCm * btScalar(0.01);
+    btScalar maxLength = t.restLength + t.maxSuspensionTravelCm * btScalar(0.01);
+
+    // scene queries, one per vehicle
+    for (int c = 0; c < n; ++c)
+    {
+      btVector3 from = lane.hardPoint.get(c);
+      btVector3 to = from + lane.direction.get(c) * rayLength;
+
+      btVehicleRaycaster::btVehicleRaycasterResult result;
+
+      if (m_raycasters[c]->castRay(from, to, result))
+      {
+        btScalar length = result.m_distFraction * rayLength - t.radius;
+
+        lane.inContact[c] = 1;
+        lane.suspensionLength[c] = btMin(btMax(length, minLength), maxLength);
+        lane.contactPoint.set(c, result.m_hitPointInWorld);
+        lane.contactNormal.set(c, result.m_hitNormalInWorld);
+      }
+      else
+      {
+        // wheel in rest position
+        lane.inContact[c] = 0;
+        lane.suspensionLength[c] = t.restLength;
+        lane.contactPoint.set(c, to);
+        lane.contactNormal.set(c, -lane.direction.get(c));
+      }
+    }
+
+    // relative velocity of the suspension
+    const btScalar* contact = &lane.inContact[0];
+    const btScalar* nx = &lane.contactNormal.x[0];
+    const btScalar* ny = &lane.contactNormal.y[0];
+    const btScalar* nz = &lane.contactNormal.z[0];
+    const btScalar* dx = &lane.direction.x[0];
+    const btScalar* dy = &lane.direction.y[0];
+    const btScalar* dz = &lane.direction.z[0];
+    btScalar* relVel = &lane.relativeVelocity[0];
+    btScalar* clippedInv = &lane.clippedInvContactDotSuspension[0];
+
+    for (int c = 0; c < n; ++c)
+    {
+      btScalar px = lane.contactPoint.x[c] - m_centerOfMass.x[c];
+      btScalar py = lane.contactPoint.y[c] - m_centerOfMass.y[c];
+      btScalar pz = lane.contactPoint.z[c] - m_centerOfMass.z[c];
+
+      btScalar wx = m_angularVelocity.x[c], wy = m_angularVelocity.y[c], wz = m_angularVelocity.z[c];
+
+      btScalar vx = m_linearVelocity.x[c] + (wy * pz - wz * py);
+      btScalar vy = m_linearVelocity.y[c] + (wz * px - wx * pz);
+      btScalar vz = m_linearVelocity.z[c] + (wx * py - wy * px);
+
+      btScalar projVel = nx[c] * vx + ny[c] * vy + nz[c] * vz;
+      btScalar denominator = nx[c] * dx[c] + ny[c] * dy[c] + nz[c] * dz[c];
+
+      bool clipped = denominator >= btScalar(-0.1);
+      btScalar inv = btScalar(-1.) / (clipped ? btScalar(-1.) : denominator);
+
+      relVel[c] = (contact[c] != 0 && !clipped) ? projVel * inv : btScalar(0.);
+      clippedInv[c] = contact[c] != 0 ? (clipped ? btScalar(1.) / btScalar(0.1) : inv) : btScalar(1.);
+    }
+  }
+}
+
+void RaycastVehicleBatch::updateSuspension(btScalar step)
+{
+  int n = static_cast<int>(m_vehicles.size());
+
+  const btScalar* invMass = &m_invMass[0];
+
+  for (size_t k = 0; k < m_lanes.size(); ++k)
+  {
+    const WheelTuning& t = m_tuning[k];
+    WheelLane& lane = m_lanes[k];
+
+    const btScalar* contact = &lane.inContact[0];
+    const btScalar* length = &lane.suspensionLength[0];
+    const btScalar* relVel = &lane.relativeVelocity[0];
+    const btScalar* clippedInv = &lane.clippedInvContactDotSuspension[0];
+    btScalar* force = &lane.suspensionForce[0];
+
+    for (int c = 0; c < n; ++c)
+    {
+      // spring and damper
+      btScalar f = t.stiffness * (t.restLength - length[c]) * clippedInv[c];
+      btScalar damping = relVel[c] < btScalar(0.) ? t.dampingCompression : t.dampingRelaxation;
+      f -= damping * relVel[c];
+
+      f *= btScalar(1.) / invMass[c];
+
+      force[c] = (contact[c] != 0 && f > btScalar(0.)) ? f : btScalar(0.);
+
+      btScalar impulse = btMin(force[c], t.maxSuspensionForce);
+
+      m_impulse.x[c] = lane.contactNormal.x[c] * impulse * step;
+      m_impulse.y[c] = lane.contactNormal.y[c] * impulse * step;
+      m_impulse.z[c] = lane.contactNormal.z[c] * impulse * step;
+
+      m_relPos.x[c] = lane.contactPoint.x[c] - m_centerOfMass.x[c];
+      m_relPos.y[c] = lane.contactPoint.y[c] - m_centerOfMass.y[c];
+      m_relPos.z[c] = lane.contactPoint.z[c] - m_centerOfMass.z[c];
+    }
+
+    applyImpulse();
+  }
+}
+
+void RaycastVehicleBatch::updateFriction(btScalar step)
+{
+  int n = static_cast<int>(m_vehicles.size());
+
+  const btScalar* b[9];
+  const btScalar* iw[9];
+  for (int i = 0; i < 9; ++i)
+  {
+    b[i] = &m_basis[i][0];
+    iw[i] = &m_invInertiaWorld[i][0];
+  }
+
+  // impulses of all wheels are computed from the velocities after the suspension impulses
+  for (size_t k = 0; k < m_lanes.size(); ++k)
+  {
+    const WheelTuning& t = m_tuning[k];
+    WheelLane& lane = m_lanes[k];
+
+    for (int c = 0; c < n; ++c)
+    {
+      btScalar nx = lane.contactNormal.x[c], ny = lane.contactNormal.y[c], nz = lane.contactNormal.z[c];
+
+      // axle projected on contact plane
+      btScalar ax = lane.wheelAxle.x[c], ay = lane.wheelAxle.y[c], az = lane.wheelAxle.z[c];
+      btScalar proj = ax * nx + ay * ny + az * nz;
+      ax -= nx * proj;
+      ay -= ny * proj;
+      az -= nz * proj;
+
+      btScalar invLen = btScalar(1.) / btSqrt(ax * ax + ay * ay + az * az);
+      ax *= invLen;
+      ay *= invLen;
+      az *= invLen;
+
+      btScalar fx = ny * az - nz * ay;
+      btScalar fy = nz * ax - nx * az;
+      btScalar fz = nx * ay - ny * ax;
+
+      invLen = btScalar(1.) / btSqrt(fx * fx + fy * fy + fz * fz);
+      fx *= invLen;
+      fy *= invLen;
+      fz *= invLen;
+
+      lane.axle.x[c] = ax;
+      lane.axle.y[c] = ay;
+      lane.axle.z[c] = az;
+
+      lane.forward.x[c] = fx;
+      lane.forward.y[c] = fy;
+      lane.forward.z[c] = fz;
+
+      // chassis velocity at contact, the ground is static
+      btScalar px = lane.contactPoint.x[c] - m_centerOfMass.x[c];
+      btScalar py = lane.contactPoint.y[c] - m_centerOfMass.y[c];
+      btScalar pz = lane.contactPoint.z[c] - m_centerOfMass.z[c];
+
+      btScalar wx = m_angularVelocity.x[c], wy = m_angularVelocity.y[c], wz = m_angularVelocity.z[c];
+
+      btScalar vx = m_linearVelocity.x[c] + (wy * pz - wz * py);
+      btScalar vy = m_linearVelocity.y[c] + (wz * px - wx * pz);
+      btScalar vz = m_linearVelocity.z[c] + (wx * py - wy * px);
+
+      // side impulse as resolveSingleBilateral, jacobian in chassis space
+      btScalar jx = py * az - pz * ay;
+      btScalar jy = pz * ax - px * az;
+      btScalar jz = px * ay - py * ax;
+
+      btScalar lx = b[0][c] * jx + b[3][c] * jy + b[6][c] * jz;
+      btScalar ly = b[1][c] * jx + b[4][c] * jy + b[7][c] * jz;
+      btScalar lz = b[2][c] * jx + b[5][c] * jy + b[8][c] * jz;
+
+      btScalar jacDiag = m_invMass[c] + m_invInertiaLocal.x[c] * lx * lx + m_invInertiaLocal.y[c] * ly * ly + m_invInertiaLocal.z[c] * lz * lz;
+
+      btScalar side = btScalar(-0.2) * (ax * vx + ay * vy + az * vz) * (btScalar(1.) / jacDiag);
+
+      // rolling friction along forward direction as calcRollingFriction
+      btScalar qx = py * fz - pz * fy;
+      btScalar qy = pz * fx - px * fz;
+      btScalar qz = px * fy - py * fx;
+
+      btScalar mx = iw[0][c] * qx + iw[3][c] * qy + iw[6][c] * qz;
+      btScalar my = iw[1][c] * qx + iw[4][c] * qy + iw[7][c] * qz;
+      btScalar mz = iw[2][c] * qx + iw[5][c] * qy + iw[8][c] * qz;
+
+      btScalar denom = m_invMass[c] + fx * (my * pz - mz * py) + fy * (mz * px - mx * pz) + fz * (mx * py - my * px);
+
+      btScalar maxImpulse = lane.brake[c];
+      btScalar rolling = -(fx * vx + fy * vy + fz * vz) * (btScalar(1.) / denom);
+      rolling = btMax(btMin(rolling, maxImpulse), -maxImpulse);
+
+      if (lane.engineForce[c] != btScalar(0.))
+        rolling = lane.engineForce[c] * step;
+
+      // limit by friction of the suspension force, scale down skidding wheels
+      btScalar maxImp = lane.suspensionForce[c] * step * t.frictionSlip;
+
+      btScalar x = rolling * btScalar(0.5);
+      btScalar y = side;
+      btScalar impulseSquared = x * x + y * y;
+
+      btScalar skid = impulseSquared > maxImp * maxImp ? maxImp / btSqrt(impulseSquared) : btScalar(1.);
+      btScalar scale = (side != btScalar(0.) && skid < btScalar(1.)) ? skid : btScalar(1.);
+
+      bool contact = lane.inContact[c] != 0;
+      lane.sideImpulse[c] = contact ? side * scale : btScalar(0.);
+      lane.forwardImpulse[c] = contact ? rolling * scale : btScalar(0.);
+    }
+  }
+
+  // apply forward and side impulse per wheel
+  for (size_t k = 0; k < m_lanes.size(); ++k)
+  {
+    const WheelTuning& t = m_tuning[k];
+    WheelLane& lane = m_lanes[k];
+
+    for (int c = 0; c < n; ++c)
+    {
+      m_impulse.x[c] = lane.forward.x[c] * lane.forwardImpulse[c];
+      m_impulse.y[c] = lane.forward.y[c] * lane.forwardImpulse[c];
+      m_impulse.z[c] = lane.forward.z[c] * lane.forwardImpulse[c];
+
+      m_relPos.x[c] = lane.contactPoint.x[c] - m_centerOfMass.x[c];
+      m_relPos.y[c] = lane.contactPoint.y[c] - m_centerOfMass.y[c];
+      m_relPos.z[c] = lane.contactPoint.z[c] - m_centerOfMass.z[c];
+    }
+
+    applyImpulse();
+
+    for (int c = 0; c < n; ++c)
+    {
+      m_impulse.x[c] = lane.axle.x[c] * lane.sideImpulse[c];
+      m_impulse.y[c] = lane.axle.y[c] * lane.sideImpulse[c];
+      m_impulse.z[c] = lane.axle.z[c] * lane.sideImpulse[c];
+
+      // roll influence moves the point of application towards the chassis center along up
+      btScalar ux = b[m_upAxis][c], uy = b[3 + m_upAxis][c], uz = b[6 + m_upAxis][c];
+      btScalar d = (ux * m_relPos.x[c] + uy * m_relPos.y[c] + uz * m_relPos.z[c]) * (btScalar(1.) - t.rollInfluence);
+
+      m_relPos.x[c] -= ux * d;
+      m_relPos.y[c] -= uy * d;
+      m_relPos.z[c] -= uz * d;
+    }
+
+    applyImpulse();
+  }
+}
+
+void RaycastVehicleBatch::updateRotation(btScalar step)
+{
+  int n = static_cast<int>(m_vehicles.size());
+
+  const btScalar* fwdx = &m_basis[m_forwardAxis][0];
+  const btScalar* fwdy = &m_basis[3 + m_forwardAxis][0];
+  const btScalar* fwdz = &m_basis[6 + m_forwardAxis][0];
+
+  for (size_t k = 0; k < m_lanes.size(); ++k)
+  {
+    const WheelTuning& t = m_tuning[k];
+    WheelLane& lane = m_lanes[k];
+
+    for (int c = 0; c < n; ++c)
+    {
+      btScalar px = lane.hardPoint.x[c] - m_centerOfMass.x[c];
+      btScalar py = lane.hardPoint.y[c] - m_centerOfMass.y[c];
+      btScalar pz = lane.hardPoint.z[c] - m_centerOfMass.z[c];
+
+      btScalar wx = m_angularVelocity.x[c], wy = m_angularVelocity.y[c], wz = m_angularVelocity.z[c];
+
+      btScalar vx = m_linearVelocity.x[c] + (wy * pz - wz * py);
+      btScalar vy = m_linearVelocity.y[c] + (wz * px - wx * pz);
+      btScalar vz = m_linearVelocity.z[c] + (wx * py - wy * px);
+
+      // chassis forward projected on contact plane
+      btScalar nx = lane.contactNormal.x[c], ny = lane.contactNormal.y[c], nz = lane.contactNormal.z[c];
+      btScalar proj = fwdx[c] * nx + fwdy[c] * ny + fwdz[c] * nz;
+
+      btScalar fx = fwdx[c] - nx * proj;
+      btScalar fy = fwdy[c] - ny * proj;
+      btScalar fz = fwdz[c] - nz * proj;
+
+      btScalar delta = (fx * vx + fy * vy + fz * vz) * step / t.radius;
+
+      // wheels in the air keep spinning
+      if (lane.inContact[c] != 0)
+        lane.deltaRotation[c] = delta;
+
+      lane.rotation[c] += lane.deltaRotation[c];
+      lane.deltaRotation[c] *= btScalar(0.99);
+    }
+  }
+}
+
+void RaycastVehicleBatch::applyImpulse()
+{
+  int n = static_cast<int>(m_vehicles.size());
+
+  const btScalar* iw[9];
+  for (int i = 0; i < 9; ++i)
+    iw[i] = &m_invInertiaWorld[i][0];
+
+  for (int c = 0; c < n; ++c)
+  {
+    btScalar ix = m_impulse.x[c], iy = m_impulse.y[c], iz = m_impulse.z[c];
+    btScalar px = m_relPos.x[c], py = m_relPos.y[c], pz = m_relPos.z[c];
+
+    m_linearVelocity.x[c] += ix * m_invMass[c];
+    m_linearVelocity.y[c] += iy * m_invMass[c];
+    m_linearVelocity.z[c] += iz * m_invMass[c];
+
+    btScalar tx = py * iz - pz * iy;
+    btScalar ty = pz * ix - px * iz;
+    btScalar tz = px * iy - py * ix;
+
+    m_angularVelocity.x[c] += iw[0][c] * tx + iw[1][c] * ty + iw[2][c] * tz;
+    m_angularVelocity.y[c] += iw[3][c] * tx + iw[4][c] * ty + iw[5][c] * tz;
+    m_angularVelocity.z[c] += iw[6][c] * tx + iw[7][c] * ty + iw[8][c] * tz;
+  }
+}
+
+
+void RaycastVehicleBatch::debugDraw(btIDebugDraw* drawer)
+{
+  int n = static_cast<int>(m_vehicles.size());
+
+  for (int c = 0; c < n; ++c)
+  {
+    for (size_t k = 0; k < m_lanes.size(); ++k)
+    {
+      const WheelLane& lane = m_lanes[k];
+
+      btVector3 color = lane.inContact[c] != 0 ? btVector3(0, 0, 1) : btVector3(1, 0, 1);
+      btVector3 pos = lane.position.get(c);
+
+      drawer->drawLine(pos, pos + lane.wheelAxle.get(c), color);
+      drawer->drawLine(pos, lane.contactPoint.get(c), color);
+    }
+  }
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <btBulletDynamicsCommon.h>
+
+#include <vector>
+
+
+// Steps many btRaycastVehicles as one action with the vehicle and wheel state kept in structure of arrays layout.
+// Wheel k of all vehicles forms a lane, every kernel loops over the vehicles of a lane with plain arrays
+// of scalars so the compiler can vectorize it. Only the wheel raycasts remain a per-vehicle call.
+// The math follows btRaycastVehicle::updateVehicle step by step and impulses are applied in the same order,
+// so results match the bullet implementation up to rounding.
+// Restrictions: all vehicles share the wheel setup of the first one, the ground is always static,
+// linear and angular factors of the chassis are 1 and the vehicle speed (getCurrentSpeedKmHour) is not updated.
+// Steering, engine force and brake are still set through btRaycastVehicle and read at the start of each step.
+class RaycastVehicleBatch : public btActionInterface
+{
+public:
+
+  RaycastVehicleBatch();
+  virtual ~RaycastVehicleBatch();
+
+
+  // take over simulation of vehicle, it must not be added to the world as action.
+  // returns false if the wheel setup differs from the vehicles already in the batch
+  bool add(btRaycastVehicle* vehicle, btVehicleRaycaster* raycaster);
+  void remove(btRaycastVehicle* vehicle);
+
+  bool contains(btRaycastVehicle* vehicle) const;
+
+  // copy persistent wheel state (rotation, suspension length) from the lanes to btWheelInfo and back.
+  // vehicles not in the batch are ignored
+  void storeWheels(btRaycastVehicle* vehicle) const;
+  void loadWheels(btRaycastVehicle* vehicle);
+
+  // copy wheel state of all vehicles in the batch to btWheelInfo
+  void storeWheels() const;
+
+  int size() const { return static_cast<int>(m_vehicles.size()); }
+
+
+  virtual void updateAction(btCollisionWorld* world, btScalar step);
+
+  // same wheel lines as btRaycastVehicle::debugDraw
+  virtual void debugDraw(btIDebugDraw* drawer);
+
+private:
+
+  // components of a vector per vehicle
+  struct Vec3Array
+  {
+    std::vector<btScalar> x, y, z;
+
+    void resize(size_t n) { x.resize(n); y.resize(n); z.resize(n); }
+    void swapRemove(size_t i) { x[i] = x.back(); y[i] = y.back(); z[i] = z.back(); x.pop_back(); y.pop_back(); z.pop_back(); }
+
+    btVector3 get(size_t i) const { return btVector3(x[i], y[i], z[i]); }
+    void set(size_t i, const btVector3& v) { x[i] = v.x(); y[i] = v.y(); z[i] = v.z(); }
+  };
+
+  // wheel setup shared by all vehicles
+  struct WheelTuning
+  {
+    btVector3 connectionCS;
+    btVector3 directionCS;
+    btVector3 axleCS;
+    btScalar restLength;
+    btScalar radius;
+    btScalar stiffness;
+    btScalar dampingCompression;
+    btScalar dampingRelaxation;
+    btScalar frictionSlip;
+    btScalar maxSuspensionTravelCm;
+    btScalar maxSuspensionForce;
+    btScalar rollInfluence;
+  };
+
+  // state of wheel k of all vehicles
+  struct WheelLane
+  {
+    // controls copied from btWheelInfo
+    std::vector<btScalar> steering;
+    std::vector<btScalar> engineForce;
+    std::vector<btScalar> brake;
+
+    // persistent over steps
+    std::vector<btScalar> rotation;
+    std::vector<btScalar> deltaRotation;
+    std::vector<btScalar> suspensionLength;
+
+    // per step
+    Vec3Array hardPoint;
+    Vec3Array direction;
+    Vec3Array wheelAxle;     // steered axle
+    Vec3Array axle;          // steered axle projected on the contact plane
+    Vec3Array forward;
+    Vec3Array position;      // wheel center for debug drawing
+    Vec3Array contactPoint;
+    Vec3Array contactNormal;
+    std::vector<btScalar> inContact; // 1 or 0
+    std::vector<btScalar> relativeVelocity;
+    std::vector<btScalar> clippedInvContactDotSuspension;
+    std::vector<btScalar> suspensionForce;
+    std::vector<btScalar> sideImpulse;
+    std::vector<btScalar> forwardImpulse;
+
+    void resize(size_t n);
+    void swapRemove(size_t i);
+  };
+
+  static bool sameTuning(const WheelTuning& a, const WheelTuning& b);
+  static WheelTuning tuningOf(const btWheelInfo& wheel);
+
+  // copy wheel state of vehicle c to its btWheelInfo
+  void storeWheels(size_t c) const;
+
+  // kernels, in order of btRaycastVehicle::updateVehicle
+  void gather();
+  void updateWheelTransforms();
+  void rayCast();
+  void updateSuspension(btScalar step);
+  void updateFriction(btScalar step);
+  void updateRotation(btScalar step);
+  void scatter();
+
+  // apply m_impulse at m_relPos to the chassis of all vehicles
+  void applyImpulse();
+
+private:
+
+  std::vector<btRaycastVehicle*> m_vehicles;
+  std::vector<btRigidBody*> m_bodies;
+  std::vector<btVehicleRaycaster*> m_raycasters;
+
+  // chassis axis indices of the first vehicle
+  int m_upAxis;
+  int m_forwardAxis;
+
+  std::vector<WheelTuning> m_tuning;
+  std::vector<WheelLane> m_lanes;
+
+  // chassis state, basis[r * 3 + c] holds row r column c of the rotation
+  std::vector<btScalar> m_basis[9];
+  Vec3Array m_centerOfMass;
+  Vec3Array m_linearVelocity;
+  Vec3Array m_angularVelocity;
+  std::vector<btScalar> m_invMass;
+  Vec3Array m_invInertiaLocal;
+  std::vector<btScalar> m_invInertiaWorld[9];
+
+  // scratch per lane
+  Vec3Array m_relPos;
+  Vec3Array m_impulse;
+};
@@ -0,0 +1,160 @@
+#include "RenderQueue.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+RenderQueue::Item::Item()
+  : program(0), polygonMode(GL_FILL), matrixLoc(-1), matrix(1.0f), colorLoc(-1), color(1.0f),
+  mesh(0), vbo(0), offset(0), stride(12), numVertices(0), primitive(GL_LINES),
+  instanceVbo(0), instanceOffset(0), instanceStride(0), numInstanceAttribs(0), numInstances(0)
+{
+}
+
+RenderQueue::RenderQueue()
+  : m_numDrawn(0), m_numStateChanges(0)
+{
+}
+
+RenderQueue::~RenderQueue()
+{
+}
+
+void RenderQueue::add(const Item& item)
+{
+  if (item.program && item.program->valid())
+    m_items.push_back(item);
+}
+
+void RenderQueue::submit()
+{
+  int n = static_cast<int>(m_items.size());
+
+  // stable, items with equal state keep their recording order
+  m_order.resize(n);
+  for (int i = 0; i < n; ++i)
+    m_order[i] = i;
+
+  std::stable_sort(m_order.begin(), m_order.end(), [this](int a, int b)
+  {
+    const Item& x = m_items[a];
+    const Item& y = m_items[b];
+    if (x.program->id() != y.program->id())
+      return x.program->id() < y.program->id();
+    return x.polygonMode < y.polygonMode;
+  });
+
+  m_uniforms.clear();
+  m_numDrawn = 0;
+  m_numStateChanges = 0;
+
+  GL::Program* program = 0;
+  GLenum polygonMode = GL_FILL;
+  glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+  for (int i = 0; i < n; ++i)
+  {
+    const Item& item = m_items[m_order[i]];
+
+    if (item.program != program)
+    {
+      item.program->use();
+      program = item.program;
+      ++m_numStateChanges;
+    }
+
+    if (item.polygonMode != polygonMode)
+    {
+      glPolygonMode(GL_FRONT_AND_BACK, item.polygonMode);
+      polygonMode = item.polygonMode;
+      ++m_numStateChanges;
+    }
+
+    if (item.matrixLoc >= 0 && uniformChanged(program->id(), item.matrixLoc, &item.matrix[0][0], 16))
+      program->setUniformMatrix4f(item.matrixLoc, item.matrix);
+
+    if (item.colorLoc >= 0 && uniformChanged(program->id(), item.colorLoc, &item.color[0], 4))
+      program->setUniform4f(item.colorLoc, item.color);
+
+    draw(item);
+  }
+
+  if (program)
+    program->disable();
+  if (polygonMode != GL_FILL)
+    glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+  m_items.clear();
+}
+
+bool RenderQueue::uniformChanged(GLuint program, GLint loc, const float* value, int n)
+{
+  // few programs and uniforms per frame, linear search is enough
+  for (size_t i = 0; i < m_uniforms.size(); ++i)
+  {
+    UniformState& u = m_uniforms[i];
+    if (u.program == program && u.loc == loc)
+    {
+      if (!std::memcmp(u.value, value, n * sizeof(float)))
+        return false;
+
+      std::memcpy(u.value, value, n * sizeof(float));
+      return true;
+    }
+  }
+
+  UniformState u;
+  u.program = program;
+  u.loc = loc;
+  std::memcpy(u.value, value, n * sizeof(float));
+  m_uniforms.push_back(u);
+  return true;
+}
+
+void RenderQueue::draw(const Item& item)
+{
+  if (item.mesh)
+  {
+    if (!item.instanceVbo)
+    {
+      item.mesh->draw();
+      ++m_numDrawn;
+      return;
+    }
+
+    if (item.numInstances <= 0)
+      return;
+
+    item.instanceVbo->bind();
+    for (int i = 0; i < item.numInstanceAttribs; ++i)
+    {
+      glEnableVertexAttribArray(1 + i);
+      glVertexAttribPointer(1 + i, 4, GL_FLOAT, GL_FALSE, item.instanceStride, reinterpret_cast<const void*>(item.instanceOffset + i * 16));
+      glVertexAttribDivisor(1 + i, 1);
+    }
+    item.instanceVbo->unbind();
+
+    item.mesh->drawInstanced(item.numInstances);
+    ++m_numDrawn;
+
+    for (int i = 0; i < item.numInstanceAttribs; ++i)
+    {
+      glVertexAttribDivisor(1 + i, 0);
+      glDisableVertexAttribArray(1 + i);
+    }
+    return;
+  }
+
+  if (item.vbo && item.numVertices > 0)
+  {
+    item.vbo->bind();
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, item.stride, reinterpret_cast<const void*>(item.offset));
+
+    glDrawArrays(item.primitive, 0, item.numVertices);
+    ++m_numDrawn;
+
+    glDisableVertexAttribArray(0);
+    item.vbo->unbind();
+  }
+}
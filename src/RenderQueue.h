@@ -0,0 +1,86 @@
+#pragma once
+
+#include "GLObjects.h"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+
+// Draw calls of one frame, recorded first and submitted together.
+// Items are sorted by program and polygon mode, submit only changes state that differs from the previous item
+// and skips uniform uploads of values the program already got in this submit.
+// Uniform locations are recorded resolved. Vertex data must stay valid until submit,
+// so a stream buffer must not be mapped again after one of its ranges was recorded.
+class RenderQueue
+{
+public:
+
+  struct Item
+  {
+    Item();
+
+    GL::Program* program;
+    GLenum polygonMode;
+
+    // uniforms, location -1 if not used
+    GLint matrixLoc;
+    glm::mat4 matrix;
+    GLint colorLoc;
+    glm::vec4 color;
+
+    // geometry: mesh, or 3 float positions in vbo at byte offset
+    GL::Mesh* mesh;
+    GL::VertexBuffer* vbo;
+    GLintptr offset;
+    int stride;
+    int numVertices;
+    GLenum primitive;
+
+    // instanced mesh: numInstanceAttribs vec4 attributes per instance starting at location 1
+    GL::VertexBuffer* instanceVbo;
+    GLintptr instanceOffset;
+    int instanceStride;
+    int numInstanceAttribs;
+    int numInstances;
+  };
+
+  RenderQueue();
+  virtual ~RenderQueue();
+
+
+  // items without a valid program are ignored
+  void add(const Item& item);
+
+  // draw and clear all items, leaves no program in use and polygon mode fill
+  void submit();
+
+  // statistics of the last submit
+  int numDrawn() const { return m_numDrawn; }
+  int numStateChanges() const { return m_numStateChanges; }
+
+private:
+
+  // uniform value last uploaded to a location of a program
+  struct UniformState
+  {
+    GLuint program;
+    GLint loc;
+    float value[16];
+  };
+
+  // true if value differs from the last upload, records it
+  bool uniformChanged(GLuint program, GLint loc, const float* value, int n);
+
+  void draw(const Item& item);
+
+private:
+
+  std::vector<Item> m_items;
+  std::vector<int> m_order;
+
+  std::vector<UniformState> m_uniforms;
+
+  int m_numDrawn;
+  int m_numStateChanges;
+};
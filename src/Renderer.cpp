@@ -3,36 +3,81 @@
 
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <algorithm>
+#include <sstream>
+
 
 Renderer::Renderer()
   : m_width(0), m_height(0), m_bar(0),
-  m_singleColorProg(0), m_gridVBO(0), m_coordsysVBO(0),
-  m_sphereMesh(0), m_boxMesh(0), m_trackMesh(0)
+  m_singleColorProg(0), m_instanceProg(0), m_singleColorWVP(-1), m_singleColorColor(-1), m_instanceVP(-1), m_queue(0), m_gridVBO(0), m_coordsysVBO(0), m_trackSegmentsVBO(0), m_lineStream(0), m_instanceStream(0), m_debugDraw(false), m_simulationThreaded(false), m_maxSensorVehicles(8),
+  m_numVehiclesAlive(0), m_bestDistance(0.0f), m_avgDistance(0.0f), m_generation(0),
+  m_sphereMesh(0), m_boxMesh(0), m_trackMesh(0),
+  m_capture(0), m_captureEnabled(false), m_capturePath("../capture"), m_captureFormat(FrameCapture::Png),
+  m_numRecordings(0), m_numCapturedFrames(0), m_numDroppedFrames(0)
 {
   // basic shader 
 
   m_singleColorProg = new GL::Program();
   m_singleColorProg->linkFromFile("../data/shaders/simple_vs.glsl", "../data/shaders/simple_fs.glsl");
 
+  m_instanceProg = new GL::Program();
+  m_instanceProg->linkFromFile("../data/shaders/instanced_vs.glsl", "../data/shaders/instanced_fs.glsl");
+
+  // uniform locations for the render queue
+  m_singleColorWVP = m_singleColorProg->uniformLocation("WVP");
+  m_singleColorColor = m_singleColorProg->uniformLocation("color");
+  m_instanceVP = m_instanceProg->uniformLocation("VP");
+
+  m_queue = new RenderQueue();
+
   m_sphereMesh = new GL::Mesh("../data/obj/sphere.obj");
   m_boxMesh = new GL::Mesh("../data/obj/cube.obj");
 
+  m_lineStream = new GL::StreamBuffer();
+  m_instanceStream = new GL::StreamBuffer();
+
 
   m_bar = TwNewBar("TweakBar");
+
+  TwAddVarRW(m_bar, "DebugDraw", TW_TYPE_BOOLCPP, &m_debugDraw, "group=Rendering");
+  TwAddVarRW(m_bar, "SensorVehicles", TW_TYPE_INT32, &m_maxSensorVehicles, "min=0 max=10000 group=Rendering");
+
+  TwAddVarRO(m_bar, "Generation", TW_TYPE_INT32, &m_generation, "group=Performance");
+  TwAddVarRO(m_bar, "BestDistance", TW_TYPE_FLOAT, &m_bestDistance, "group=Performance");
+  TwAddVarRO(m_bar, "AvgDistance", TW_TYPE_FLOAT, &m_avgDistance, "group=Performance");
+  TwAddVarRO(m_bar, "NumAlive", TW_TYPE_INT32, &m_numVehiclesAlive, "group=Performance");
+
+  TwAddVarRW(m_bar, "Record", TW_TYPE_BOOLCPP, &m_captureEnabled, "group=Capture");
+  TwAddVarRO(m_bar, "CapturedFrames", TW_TYPE_INT32, &m_numCapturedFrames, "group=Capture");
+  TwAddVarRO(m_bar, "DroppedFrames", TW_TYPE_INT32, &m_numDroppedFrames, "group=Capture");
 }
 
 Renderer::~Renderer()
 {
+  delete m_capture;
+  delete m_queue;
+
+  delete m_trackMesh;
   delete m_boxMesh;
   delete m_sphereMesh;
+  delete m_instanceProg;
   delete m_singleColorProg;
 
+  delete m_instanceStream;
+  delete m_lineStream;
+  delete m_trackSegmentsVBO;
   delete m_coordsysVBO;
   delete m_gridVBO;
 }
 
-void Renderer::draw(double time, Simulation* sim, Camera* cam)
+void Renderer::draw(double time, const SimulationFrame& frame, double alpha, Simulation* sim, Camera* cam)
 {
+  // statistics shown in the tweak bar
+  m_numVehiclesAlive = frame.numVehiclesAlive;
+  m_bestDistance = frame.bestDistance;
+  m_avgDistance = frame.avgDistance;
+  m_generation = frame.generation;
+
   glViewport(0, 0, m_width, m_height);
   glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
   glClear(GL_COLOR_BUFFER_BIT);
@@ -41,77 +86,92 @@ void Renderer::draw(double time, Simulation* sim, Camera* cam)
   cam->perspective(90.0f * 3.14159f / 180.0f, static_cast<float>(m_width) / m_height, 0.0001f, 100.0f);
 
 
-  glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-
   glm::mat4 viewProj = cam->proj() * cam->view();
+  Frustum frustum(viewProj);
 
 
-  if (m_trackMesh)
+  // static track is uploaded once, the debug drawer only draws dynamic bodies
+  if (!m_trackMesh && sim->trackHeightfield())
   {
-    m_singleColorProg->use();
-    m_singleColorProg->setUniform4f("color", glm::vec4(0.0f, 1.0f, 0.0f, 1.0f));
-    m_singleColorProg->setUniformMatrix4f("WVP", viewProj);
+    buildTrackMesh(sim->trackHeightfield());
 
-    m_trackMesh->draw();
+    if (!m_simulationThreaded)
+    {
+      int f = sim->trackBody()->getCollisionFlags();
+      sim->trackBody()->setCollisionFlags(f | btCollisionObject::CF_DISABLE_VISUALIZE_OBJECT);
+    }
+  }
 
-    // disable visualization in debug drawer to prevent crash
-    int f = sim->trackBody()->getCollisionFlags();
-    sim->trackBody()->setCollisionFlags(f | btCollisionObject::CF_DISABLE_VISUALIZE_OBJECT);
+  if (m_trackMesh)
+  {
+    RenderQueue::Item item;
+    item.program = m_singleColorProg;
+    item.polygonMode = GL_LINE;
+    item.matrixLoc = m_singleColorWVP;
+    item.matrix = viewProj;
+    item.colorLoc = m_singleColorColor;
+    item.color = glm::vec4(0.0f, 1.0f, 0.0f, 1.0f);
+    item.mesh = m_trackMesh;
+    m_queue->add(item);
   }
 
-  glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+  drawVehicles(frame, alpha, frustum, viewProj);
 
 
 
 
-  // draw sensor info
+  // draw sensor info of the visible vehicles nearest to the camera
   {
-    static std::vector<float> sensorLines;
-    
-    sensorLines.clear();
-    for (int i = 0; i < sim->numVehicles(); ++i)
-    {
-      Vehicle* v = sim->vehicle(i);
+    selectSensorVehicles(frame, frustum, cam->pos());
 
-      if (v)
-      {
-        int ns = v->numSensors();
-        for (int i = 0; i < ns; ++i)
-        {
-          Vehicle::Sensor* s = v->sensor(i);
+    int perVehicle = frame.sensorsPerVehicle * 2;
+    int numLineVerts = static_cast<int>(m_sensorVehicles.size()) * perVehicle;
 
-          for (int k = 0; k < 3; ++k)
-            sensorLines.push_back(s->startWS[k]);
+    float* lines = numLineVerts ? reinterpret_cast<float*>(m_lineStream->map(numLineVerts * 12)) : 0;
 
-          btVector3 endWS = s->startWS + (s->endWS - s->startWS).normalized() * s->dist;
+    if (lines)
+    {
+      for (size_t v = 0; v < m_sensorVehicles.size(); ++v)
+      {
+        const btVector3* src = &frame.sensorLines[m_sensorVehicles[v].second * perVehicle];
+
+        for (int i = 0; i < perVehicle; ++i)
+        {
           for (int k = 0; k < 3; ++k)
-            sensorLines.push_back(endWS[k]);
+            *lines++ = src[i][k];
         }
       }
-    }
-
 
-    int numLineVerts = static_cast<int>(sensorLines.size() / 3);
+      GLintptr offset = m_lineStream->unmap(numLineVerts * 12);
 
-    drawLines(numLineVerts, sensorLines.data(), 12, viewProj, glm::vec4(1.0f, 0.0f, 0.0f, 1.0f));
+      drawLines(m_lineStream, offset, numLineVerts, 12, viewProj, glm::vec4(1.0f, 0.0f, 0.0f, 1.0f));
+    }
   }
   
   if (!sim->trackSegments().empty())
   {
     int numLineVerts = static_cast<int>(sim->trackSegments().size());
-    drawLines(numLineVerts, sim->trackSegments().data(), sizeof(btVector3), viewProj, glm::vec4(0.0f, 1.0f, 0.0f, 1.0f), true);
-  }
 
+    // segments are fixed once the track is loaded
+    if (!m_trackSegmentsVBO)
+    {
+      m_trackSegmentsVBO = new GL::VertexBuffer();
+      m_trackSegmentsVBO->setData(numLineVerts * sizeof(btVector3), sim->trackSegments().data());
+    }
 
+    drawLines(m_trackSegmentsVBO, 0, numLineVerts, sizeof(btVector3), viewProj, glm::vec4(0.0f, 1.0f, 0.0f, 1.0f), true);
+  }
 
 
-  m_singleColorProg->disable();
+  m_queue->submit();
 
 
 
 
 
 
+  // the world can only be drawn while the simulation waits for the renderer
+  if (m_debugDraw && !m_simulationThreaded)
   {
     static GLDebugDrawer bulletDebugDrawer;
 
@@ -121,7 +181,7 @@ void Renderer::draw(double time, Simulation* sim, Camera* cam)
     sim->world()->setDebugDrawer(&bulletDebugDrawer);
 
     bulletDebugDrawer.beginDraw();
-    sim->world()->debugDrawWorld();
+    debugDrawVisible(sim->world(), frustum);
     bulletDebugDrawer.endDraw();
   }
 
@@ -131,11 +191,35 @@ void Renderer::draw(double time, Simulation* sim, Camera* cam)
   //drawGrid();
 
 
+  updateCapture();
 
   // draw tweakbars
   TwDraw();
 }
 
+void Renderer::updateCapture()
+{
+  if (m_captureEnabled && !m_capture)
+  {
+    std::ostringstream path;
+    path << m_capturePath << m_numRecordings++;
+    m_capture = new FrameCapture(path.str(), m_captureFormat);
+  }
+  else if (!m_captureEnabled && m_capture)
+  {
+    delete m_capture;
+    m_capture = 0;
+  }
+
+  if (m_capture)
+  {
+    m_capture->capture(m_width, m_height);
+
+    m_numCapturedFrames = m_capture->numCaptured();
+    m_numDroppedFrames = m_capture->numDropped();
+  }
+}
+
 
 
 void Renderer::drawCoordSys()
@@ -186,21 +270,197 @@ void Renderer::drawGrid(const glm::mat4& wvp)
   glDrawArrays(GL_LINES, 0, n * 2 * 2);
 }
 
-void Renderer::drawLines(int numVertices, const void* vertices, int stride, const glm::mat4& wvp, const glm::vec4& color, bool strip)
+namespace
 {
-  if (numVertices)
+  // per instance data of instanced_vs.glsl
+  struct BoxInstance
   {
-    m_singleColorProg->use();
-    m_singleColorProg->setUniform4f("color", color);
-    m_singleColorProg->setUniformMatrix4f("WVP", wvp);
+    float world[16]; // column major, unit cube to world
+    float color[4];
 
-    glEnableVertexAttribArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, vertices);
+    void set(const btTransform& t, const btVector3& size, const glm::vec4& c)
+    {
+      t.getOpenGLMatrix(world);
+
+      for (int i = 0; i < 3; ++i)
+      {
+        for (int k = 0; k < 3; ++k)
+          world[i * 4 + k] *= size[i];
+      }
+
+      for (int i = 0; i < 4; ++i)
+        color[i] = c[i];
+    }
+  };
+}
+
+void Renderer::selectSensorVehicles(const SimulationFrame& frame, const Frustum& frustum, const glm::vec3& camPos)
+{
+  m_sensorVehicles.clear();
 
-    glDrawArrays(strip ? GL_LINE_STRIP : GL_LINES, 0, numVertices);
-    glDrawArrays(GL_POINTS, 0, numVertices);
+  int perVehicle = frame.sensorsPerVehicle * 2;
+  int numVehicles = perVehicle ? static_cast<int>(frame.sensorLines.size()) / perVehicle : 0;
 
-    glDisableVertexAttribArray(0);
+  for (int v = 0; v < numVehicles && m_maxSensorVehicles > 0; ++v)
+  {
+    const btVector3* lines = &frame.sensorLines[v * perVehicle];
+
+    // sphere around the first sensor start containing all rays
+    btScalar radius2 = 0.0f;
+    for (int i = 1; i < perVehicle; i += 2)
+      radius2 = std::max(radius2, lines[i].distance2(lines[0]));
+
+    glm::vec3 center(lines[0].x(), lines[0].y(), lines[0].z());
+    if (!frustum.sphereVisible(center, std::sqrt(radius2)))
+      continue;
+
+    glm::vec3 d = center - camPos;
+    m_sensorVehicles.push_back(std::make_pair(glm::dot(d, d), v));
+  }
+
+  if (static_cast<int>(m_sensorVehicles.size()) > m_maxSensorVehicles)
+  {
+    std::nth_element(m_sensorVehicles.begin(), m_sensorVehicles.begin() + m_maxSensorVehicles, m_sensorVehicles.end());
+    m_sensorVehicles.resize(m_maxSensorVehicles);
+  }
+}
+
+void Renderer::debugDrawVisible(btDynamicsWorld* world, const Frustum& frustum)
+{
+  // like btCollisionWorld::debugDrawWorld for the objects in view, without constraints and actions.
+  // the drawer uses a single color
+  const btCollisionObjectArray& objects = world->getCollisionObjectArray();
+
+  for (int i = 0; i < objects.size(); ++i)
+  {
+    const btCollisionObject* obj = objects[i];
+    if (obj->getCollisionFlags() & btCollisionObject::CF_DISABLE_VISUALIZE_OBJECT)
+      continue;
+
+    btVector3 aabbMin, aabbMax;
+    obj->getCollisionShape()->getAabb(obj->getWorldTransform(), aabbMin, aabbMax);
+
+    if (!frustum.boxVisible(glm::vec3(aabbMin.x(), aabbMin.y(), aabbMin.z()), glm::vec3(aabbMax.x(), aabbMax.y(), aabbMax.z())))
+      continue;
+
+    world->debugDrawObject(obj->getWorldTransform(), obj->getCollisionShape(), btVector3(1.0f, 1.0f, 1.0f));
+  }
+}
+
+void Renderer::drawVehicles(const SimulationFrame& frame, double alpha, const Frustum& frustum, const glm::mat4& viewProj)
+{
+  int numInstances = static_cast<int>(frame.boxes.size());
+
+  if (!numInstances || !m_boxMesh || !m_instanceProg->valid())
+    return;
+
+  BoxInstance* instances = reinterpret_cast<BoxInstance*>(m_instanceStream->map(numInstances * sizeof(BoxInstance)));
+  if (!instances)
+    return;
+
+  const glm::vec4 colors[] =
+  {
+    glm::vec4(0.2f, 0.6f, 1.0f, 1.0f), // Chassis
+    glm::vec4(0.4f, 0.4f, 0.4f, 1.0f), // DeadChassis
+    glm::vec4(0.8f, 0.8f, 0.8f, 1.0f)  // Wheel
+  };
+
+  int numBoxes = numInstances;
+  numInstances = 0;
+
+  for (int i = 0; i < numBoxes; ++i)
+  {
+    const SimulationFrame::Box& box = frame.boxes[i];
+    btTransform t = frame.boxTransform(i, static_cast<btScalar>(alpha));
+
+    const btVector3& p = t.getOrigin();
+    if (!frustum.sphereVisible(glm::vec3(p.x(), p.y(), p.z()), 0.5f * box.size.length()))
+      continue;
+
+    instances[numInstances++].set(t, box.size, colors[box.type]);
+  }
+
+  GLintptr offset = m_instanceStream->unmap(numInstances * sizeof(BoxInstance));
+
+  if (!numInstances)
+    return;
+
+  // columns of the world matrix in locations 1-4, color in 5
+  RenderQueue::Item item;
+  item.program = m_instanceProg;
+  item.polygonMode = GL_LINE;
+  item.matrixLoc = m_instanceVP;
+  item.matrix = viewProj;
+  item.mesh = m_boxMesh;
+  item.instanceVbo = m_instanceStream;
+  item.instanceOffset = offset;
+  item.instanceStride = sizeof(BoxInstance);
+  item.numInstanceAttribs = 5;
+  item.numInstances = numInstances;
+  m_queue->add(item);
+}
+
+void Renderer::buildTrackMesh(const Heightfield* heightfield)
+{
+  int w = heightfield->width();
+  int l = heightfield->length();
+
+  std::vector<float> verts;
+  verts.reserve(w * l * 3);
+
+  for (int y = 0; y < l; ++y)
+  {
+    for (int x = 0; x < w; ++x)
+    {
+      btVector3 v = heightfield->vertex(x, y);
+      verts.push_back(v.x());
+      verts.push_back(v.y());
+      verts.push_back(v.z());
+    }
+  }
+
+  std::vector<int> tris;
+  tris.reserve((w - 1) * (l - 1) * 6);
+
+  for (int y = 0; y + 1 < l; ++y)
+  {
+    for (int x = 0; x + 1 < w; ++x)
+    {
+      int i00 = y * w + x;
+      int i10 = i00 + 1;
+      int i01 = i00 + w;
+      int i11 = i01 + 1;
+
+      // (x,y),(x,y+1),(x+1,y) and (x+1,y),(x,y+1),(x+1,y+1)
+      tris.push_back(i00);
+      tris.push_back(i01);
+      tris.push_back(i10);
+
+      tris.push_back(i10);
+      tris.push_back(i01);
+      tris.push_back(i11);
+    }
+  }
+
+  delete m_trackMesh;
+  m_trackMesh = new GL::Mesh(verts.data(), w * l, tris.data(), static_cast<int>(tris.size() / 3));
+}
+
+void Renderer::drawLines(GL::VertexBuffer* vbo, GLintptr offset, int numVertices, int stride, const glm::mat4& wvp, const glm::vec4& color, bool strip)
+{
+  if (numVertices)
+  {
+    RenderQueue::Item item;
+    item.program = m_singleColorProg;
+    item.matrixLoc = m_singleColorWVP;
+    item.matrix = wvp;
+    item.colorLoc = m_singleColorColor;
+    item.color = color;
+    item.vbo = vbo;
+    item.offset = offset;
+    item.stride = stride;
+    item.numVertices = numVertices;
+    item.primitive = strip ? GL_LINE_STRIP : GL_LINES;
+    m_queue->add(item);
   }
 }
@@ -2,6 +2,8 @@
 
 
 #include "GLObjects.h"
+#include "FrameCapture.h"
+#include "RenderQueue.h"
 #include "Simulation/Simulation.h"
 
 
@@ -28,7 +30,16 @@ public:
   virtual void update(double dt) {}
 
 
-  virtual void draw(double time, Simulation* sim, Camera* cam);
+  // frame: vehicles, sensors and statistics to draw, sim: static track data.
+  // vehicles are interpolated at alpha between the previous and the current step of the frame
+  virtual void draw(double time, const SimulationFrame& frame, double alpha, Simulation* sim, Camera* cam);
+
+  // the bullet world is not accessed while the simulation runs on its own thread, no debug drawing
+  void simulationThreaded(bool threaded) { m_simulationThreaded = threaded; }
+
+  // record drawn frames without the tweak bar. each recording gets its own files starting with path and a number
+  void captureOutput(const std::string& path, FrameCapture::Format format) { m_capturePath = path; m_captureFormat = format; }
+  void capture(bool enable) { m_captureEnabled = enable; }
 
 private:
 
@@ -36,7 +47,23 @@ private:
 
   void drawGrid(const glm::mat4& wvp);
 
-  void drawLines(int numVertices, const void* vertices, int stride, const glm::mat4& wvp, const glm::vec4& color, bool strip = false);
+  // box instances for chassis and wheels of visible vehicles, queued as one call
+  void drawVehicles(const SimulationFrame& frame, double alpha, const Frustum& frustum, const glm::mat4& viewProj);
+
+  // up to m_maxSensorVehicles vehicles with sensors in view, nearest to the camera
+  void selectSensorVehicles(const SimulationFrame& frame, const Frustum& frustum, const glm::vec3& camPos);
+
+  // bullet debug drawing of the collision objects in view
+  void debugDrawVisible(btDynamicsWorld* world, const Frustum& frustum);
+
+  // one triangle mesh of the static track, split into triangles like the bullet heightfield shape
+  void buildTrackMesh(const Heightfield* heightfield);
+
+  // queue vertices at byte offset in vbo
+  void drawLines(GL::VertexBuffer* vbo, GLintptr offset, int numVertices, int stride, const glm::mat4& wvp, const glm::vec4& color, bool strip = false);
+
+  // start, stop and feed the frame capture
+  void updateCapture();
 
 private:
 
@@ -46,11 +73,46 @@ private:
 
 
   GL::Program* m_singleColorProg;
+  GL::Program* m_instanceProg;
+
+  GLint m_singleColorWVP;
+  GLint m_singleColorColor;
+  GLint m_instanceVP;
+
+  // track, vehicles and lines of a frame, sorted by program
+  RenderQueue* m_queue;
 
   GL::VertexBuffer* m_gridVBO;
   GL::VertexBuffer* m_coordsysVBO;
+  GL::VertexBuffer* m_trackSegmentsVBO;
+
+  // sensor lines and vehicle instances of the current frame
+  GL::StreamBuffer* m_lineStream;
+  GL::StreamBuffer* m_instanceStream;
+
+  // bullet wireframes of all bodies, vehicles are drawn as instances
+  bool m_debugDraw;
+  bool m_simulationThreaded;
+
+  // sensors are drawn for this many vehicles, squared camera distance and index of the selected ones
+  int m_maxSensorVehicles;
+  std::vector<std::pair<float, int> > m_sensorVehicles;
+
+  // statistics of the last drawn frame
+  int m_numVehiclesAlive;
+  float m_bestDistance;
+  float m_avgDistance;
+  int m_generation;
 
   GL::Mesh* m_sphereMesh;
   GL::Mesh* m_boxMesh;
   GL::Mesh* m_trackMesh;
+
+  FrameCapture* m_capture;
+  bool m_captureEnabled;
+  std::string m_capturePath;
+  FrameCapture::Format m_captureFormat;
+  int m_numRecordings;
+  int m_numCapturedFrames;
+  int m_numDroppedFrames;
 };
\ No newline at end of file
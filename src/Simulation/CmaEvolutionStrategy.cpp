@@ -0,0 +1,296 @@
+#include "CmaEvolutionStrategy.h"
+
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+#include <iostream>
+
+CmaEvolutionStrategy::CmaEvolutionStrategy(float sigma, unsigned int seed)
+  : m_generation(0), m_initialSigma(sigma),
+  m_n(0), m_lambda(0), m_mu(0), m_mueff(0.0),
+  m_cc(0.0), m_cs(0.0), m_c1(0.0), m_cmu(0.0), m_damps(0.0), m_chiN(0.0),
+  m_sigma(sigma), m_rng(seed)
+{
+
+}
+
+CmaEvolutionStrategy::~CmaEvolutionStrategy()
+{
+}
+
+void CmaEvolutionStrategy::initTweakVars(TwBar* bar, TweakVars* vars)
+{
+  vars->addRO(bar, "CMASigma", TW_TYPE_DOUBLE, &m_sigma, "group=Evolution");
+}
+
+void CmaEvolutionStrategy::computeNewPopulation(const std::vector<std::vector<float>*>& genes, const std::vector<float>& fitness)
+{
+  size_t n = genes.size();
+
+  if (n != fitness.size() || n < 2)
+  {
+    std::cerr << "error: genes and fitness size must be equal and at least 2" << std::endl;
+    return;
+  }
+
+  if (m_mean.empty() || m_lambda != static_cast<int>(n) || m_n != static_cast<int>(genes[0]->size()))
+  {
+    // start search from fittest individual
+    size_t best = std::max_element(fitness.begin(), fitness.end()) - fitness.begin();
+    init(*genes[best], static_cast<int>(n));
+  }
+  else
+    update(genes, fitness);
+
+  samplePopulation(genes);
+}
+
+void CmaEvolutionStrategy::init(const std::vector<float>& x, int lambda)
+{
+  int n = static_cast<int>(x.size());
+
+  m_n = n;
+  m_lambda = lambda;
+  m_mu = lambda / 2;
+  m_generation = 0;
+
+  // log-linear recombination weights
+  m_weights.resize(m_mu);
+  for (int i = 0; i < m_mu; ++i)
+    m_weights[i] = std::log(m_mu + 0.5) - std::log(i + 1.0);
+
+  double sumW = std::accumulate(m_weights.begin(), m_weights.end(), 0.0);
+  double sumW2 = 0.0;
+  for (int i = 0; i < m_mu; ++i)
+  {
+    m_weights[i] /= sumW;
+    sumW2 += m_weights[i] * m_weights[i];
+  }
+  m_mueff = 1.0 / sumW2;
+
+  // default strategy parameters (Hansen, The CMA Evolution Strategy: A Tutorial)
+  double N = static_cast<double>(n);
+  m_cc = (4.0 + m_mueff / N) / (N + 4.0 + 2.0 * m_mueff / N);
+  m_cs = (m_mueff + 2.0) / (N + m_mueff + 5.0);
+  m_c1 = 2.0 / ((N + 1.3) * (N + 1.3) + m_mueff);
+  m_cmu = std::min(1.0 - m_c1, 2.0 * (m_mueff - 2.0 + 1.0 / m_mueff) / ((N + 2.0) * (N + 2.0) + m_mueff));
+  m_damps = 1.0 + 2.0 * std::max(0.0, std::sqrt((m_mueff - 1.0) / (N + 1.0)) - 1.0) + m_cs;
+  m_chiN = std::sqrt(N) * (1.0 - 1.0 / (4.0 * N) + 1.0 / (21.0 * N * N));
+
+  m_sigma = m_initialSigma;
+  m_mean.assign(x.begin(), x.end());
+  m_pc.assign(n, 0.0);
+  m_ps.assign(n, 0.0);
+
+  m_C.assign(n * n, 0.0);
+  m_B.assign(n * n, 0.0);
+  for (int i = 0; i < n; ++i)
+  {
+    m_C[i * n + i] = 1.0;
+    m_B[i * n + i] = 1.0;
+  }
+  m_D.assign(n, 1.0);
+}
+
+void CmaEvolutionStrategy::update(const std::vector<std::vector<float>*>& genes, const std::vector<float>& fitness)
+{
+  int n = m_n;
+  int lambda = m_lambda;
+
+  // sort by fitness, best first
+  m_ranks.resize(lambda);
+  std::iota(m_ranks.begin(), m_ranks.end(), 0);
+  std::sort(m_ranks.begin(), m_ranks.end(), [&fitness](int a, int b) {return fitness[a] > fitness[b]; });
+
+  // selected steps y_i = (x_i - mean) / sigma, read from the evaluated genes
+  m_Y.resize(m_mu * n);
+  for (int k = 0; k < m_mu; ++k)
+  {
+    const float* x = genes[m_ranks[k]]->data();
+    double* y = &m_Y[k * n];
+
+    for (int i = 0; i < n; ++i)
+      y[i] = (x[i] - m_mean[i]) / m_sigma;
+  }
+
+  // weighted mean step y_w
+  std::vector<double> yw(n, 0.0);
+  for (int k = 0; k < m_mu; ++k)
+  {
+    const double* y = &m_Y[k * n];
+    double w = m_weights[k];
+
+    for (int i = 0; i < n; ++i)
+      yw[i] += w * y[i];
+  }
+
+  for (int i = 0; i < n; ++i)
+    m_mean[i] += m_sigma * yw[i];
+
+  // C^(-1/2) * y_w = B * D^-1 * B^T * y_w
+  std::vector<double> tmp(n, 0.0);
+  for (int j = 0; j < n; ++j)
+  {
+    double s = 0.0;
+    for (int i = 0; i < n; ++i)
+      s += m_B[i * n + j] * yw[i];
+    tmp[j] = s / m_D[j];
+  }
+
+  double csn = std::sqrt(m_cs * (2.0 - m_cs) * m_mueff);
+  double psNorm2 = 0.0;
+  for (int i = 0; i < n; ++i)
+  {
+    double s = 0.0;
+    const double* b = &m_B[i * n];
+    for (int j = 0; j < n; ++j)
+      s += b[j] * tmp[j];
+
+    m_ps[i] = (1.0 - m_cs) * m_ps[i] + csn * s;
+    psNorm2 += m_ps[i] * m_ps[i];
+  }
+  double psNorm = std::sqrt(psNorm2);
+
+  // stall rank-one update if step size grows too fast
+  double psCorr = std::sqrt(1.0 - std::pow(1.0 - m_cs, 2.0 * (m_generation + 1)));
+  bool hsig = psNorm / psCorr / m_chiN < 1.4 + 2.0 / (n + 1.0);
+
+  double ccn = std::sqrt(m_cc * (2.0 - m_cc) * m_mueff);
+  for (int i = 0; i < n; ++i)
+    m_pc[i] = (1.0 - m_cc) * m_pc[i] + (hsig ? ccn * yw[i] : 0.0);
+
+  // covariance: decay + rank-one + rank-mu, row by row over contiguous memory
+  double decay = 1.0 - m_c1 - m_cmu + (hsig ? 0.0 : m_c1 * m_cc * (2.0 - m_cc));
+  for (int i = 0; i < n; ++i)
+  {
+    double* c = &m_C[i * n];
+    double pci = m_c1 * m_pc[i];
+
+    for (int j = 0; j <= i; ++j)
+      c[j] = decay * c[j] + pci * m_pc[j];
+
+    for (int k = 0; k < m_mu; ++k)
+    {
+      const double* y = &m_Y[k * n];
+      double wyi = m_cmu * m_weights[k] * y[i];
+
+      for (int j = 0; j <= i; ++j)
+        c[j] += wyi * y[j];
+    }
+  }
+
+  // mirror lower to upper triangle
+  for (int i = 0; i < n; ++i)
+    for (int j = i + 1; j < n; ++j)
+      m_C[i * n + j] = m_C[j * n + i];
+
+  // step size
+  m_sigma *= std::exp((m_cs / m_damps) * (psNorm / m_chiN - 1.0));
+
+  decompose();
+
+  ++m_generation;
+}
+
+void CmaEvolutionStrategy::samplePopulation(const std::vector<std::vector<float>*>& genes)
+{
+  int n = m_n;
+  int lambda = m_lambda;
+
+  // batch of standard normal samples, scaled by D
+  std::normal_distribution<double> dist(0.0, 1.0);
+
+  m_Z.resize(lambda * n);
+  for (int k = 0; k < lambda; ++k)
+  {
+    double* z = &m_Z[k * n];
+    for (int i = 0; i < n; ++i)
+      z[i] = m_D[i] * dist(m_rng);
+  }
+
+  // x_k = mean + sigma * B * (D * z_k)
+  for (int k = 0; k < lambda; ++k)
+  {
+    const double* z = &m_Z[k * n];
+    std::vector<float>& x = *genes[k];
+    x.resize(n);
+
+    for (int i = 0; i < n; ++i)
+    {
+      const double* b = &m_B[i * n];
+      double s = 0.0;
+      for (int j = 0; j < n; ++j)
+        s += b[j] * z[j];
+
+      x[i] = static_cast<float>(m_mean[i] + m_sigma * s);
+    }
+  }
+}
+
+void CmaEvolutionStrategy::decompose()
+{
+  // cyclic jacobi eigenvalue algorithm on a copy of C
+  int n = m_n;
+
+  std::vector<double> a = m_C;
+  std::vector<double>& v = m_B;
+
+  v.assign(n * n, 0.0);
+  for (int i = 0; i < n; ++i)
+    v[i * n + i] = 1.0;
+
+  for (int sweep = 0; sweep < 50; ++sweep)
+  {
+    double off = 0.0;
+    for (int p = 0; p < n; ++p)
+      for (int q = p + 1; q < n; ++q)
+        off += a[p * n + q] * a[p * n + q];
+
+    if (off < 1e-30)
+      break;
+
+    for (int p = 0; p < n; ++p)
+    {
+      for (int q = p + 1; q < n; ++q)
+      {
+        double apq = a[p * n + q];
+        if (std::fabs(apq) < 1e-300)
+          continue;
+
+        double theta = (a[q * n + q] - a[p * n + p]) / (2.0 * apq);
+        double t = (theta >= 0.0 ? 1.0 : -1.0) / (std::fabs(theta) + std::sqrt(theta * theta + 1.0));
+        double c = 1.0 / std::sqrt(t * t + 1.0);
+        double s = t * c;
+
+        // A' = J^T A J
+        for (int k = 0; k < n; ++k)
+        {
+          double akp = a[k * n + p];
+          double akq = a[k * n + q];
+          a[k * n + p] = c * akp - s * akq;
+          a[k * n + q] = s * akp + c * akq;
+        }
+        for (int k = 0; k < n; ++k)
+        {
+          double apk = a[p * n + k];
+          double aqk = a[q * n + k];
+          a[p * n + k] = c * apk - s * aqk;
+          a[q * n + k] = s * apk + c * aqk;
+        }
+
+        // V' = V J
+        for (int k = 0; k < n; ++k)
+        {
+          double vkp = v[k * n + p];
+          double vkq = v[k * n + q];
+          v[k * n + p] = c * vkp - s * vkq;
+          v[k * n + q] = s * vkp + c * vkq;
+        }
+      }
+    }
+  }
+
+  m_D.resize(n);
+  for (int i = 0; i < n; ++i)
+    m_D[i] = std::sqrt(std::max(a[i * n + i], 1e-20));
+}
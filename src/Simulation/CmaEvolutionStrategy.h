@@ -0,0 +1,86 @@
+#pragma once
+
+#include "Optimizer.h"
+
+#include <vector>
+#include <random>
+#include <AntTweakBar.h>
+
+// covariance matrix adaptation evolution strategy (CMA-ES)
+// - samples population from N(mean, sigma^2 * C)
+// - mean: weighted recombination of the best half of the population
+// - C: rank-one update (evolution path) + rank-mu update
+// - sigma: cumulative step size adaptation
+// Suited for small genomes (up to a few hundred genes), C is dense n x n.
+
+
+
+
+class CmaEvolutionStrategy : public Optimizer
+{
+public:
+  CmaEvolutionStrategy(float sigma, unsigned int seed = 0);
+  virtual ~CmaEvolutionStrategy();
+
+
+  void initTweakVars(TwBar* bar, TweakVars* vars);
+
+  // Optimizer interface: adapt distribution to the evaluated population,
+  // then sample the next one. The first call starts from the fittest genes.
+  void computeNewPopulation(const std::vector<std::vector<float>*>& genes, const std::vector<float>& fitness);
+
+  int generation() const { return m_generation; }
+
+  const std::vector<double>& mean() const { return m_mean; }
+  double sigma() const { return m_sigma; }
+
+private:
+
+  // init distribution at x with population size lambda
+  void init(const std::vector<float>& x, int lambda);
+
+  // adapt mean, evolution paths, covariance and step size
+  void update(const std::vector<std::vector<float>*>& genes, const std::vector<float>& fitness);
+
+  // sample all lambda individuals at once: x_k = mean + sigma * B * D * z_k
+  void samplePopulation(const std::vector<std::vector<float>*>& genes);
+
+  // eigendecomposition C = B * diag(D^2) * B^T
+  void decompose();
+
+private:
+
+  // generation counter
+  int m_generation;
+
+  // initial step size
+  float m_initialSigma;
+
+  // problem dimension and population size
+  int m_n;
+  int m_lambda;
+  int m_mu;
+
+  // recombination weights
+  std::vector<double> m_weights;
+  double m_mueff;
+
+  // strategy parameters
+  double m_cc, m_cs, m_c1, m_cmu, m_damps, m_chiN;
+
+  // distribution state
+  double m_sigma;
+  std::vector<double> m_mean;
+  std::vector<double> m_pc;
+  std::vector<double> m_ps;
+  std::vector<double> m_C; // n x n, row major
+  std::vector<double> m_B; // eigenvectors in columns, row major
+  std::vector<double> m_D; // sqrt of eigenvalues
+
+  std::mt19937 m_rng;
+
+  // temporary storage
+  std::vector<double> m_Z; // lambda x n standard normal samples
+  std::vector<double> m_Y; // mu x n selected steps (x - mean) / sigma
+  std::vector<int> m_ranks;
+};
@@ -6,9 +6,10 @@
 #include <algorithm>
 #include <iostream>
 
-EvolutionProcess::EvolutionProcess(float chromosomeCrossRate, float chromosomeMutationRate, float geneMutationRate)
+EvolutionProcess::EvolutionProcess(float chromosomeCrossRate, float chromosomeMutationRate, float geneMutationRate, int numElites)
   : m_generation(0),
-  m_crossRate(chromosomeCrossRate), m_mutationRate(chromosomeMutationRate), m_mutationGeneRate(geneMutationRate)
+  m_crossRate(chromosomeCrossRate), m_mutationRate(chromosomeMutationRate), m_mutationGeneRate(geneMutationRate),
+  m_numElites(numElites)
 {
 
 }
@@ -17,12 +18,12 @@ EvolutionProcess::~EvolutionProcess()
 {
 }
 
-void EvolutionProcess::initTweakVars(TwBar* bar)
+void EvolutionProcess::initTweakVars(TwBar* bar, TweakVars* vars)
 {
-  TwAddVarRO(bar, "Generation", TW_TYPE_INT32, &m_generation, "group=Evolution");
-  TwAddVarRW(bar, "CrossRate", TW_TYPE_FLOAT, &m_crossRate, "min=0 max=1 step=0.01 group=Evolution");
-  TwAddVarRW(bar, "ChromMutRate", TW_TYPE_FLOAT, &m_mutationRate, "min=0 max=1 step=0.01 group=Evolution");
-  TwAddVarRW(bar, "GeneMutRate", TW_TYPE_FLOAT, &m_mutationGeneRate, "min=0 max=1 step=0.01 group=Evolution");
+  vars->addRW(bar, "CrossRate", TW_TYPE_FLOAT, &m_crossRate, "min=0 max=1 step=0.01 group=Evolution");
+  vars->addRW(bar, "ChromMutRate", TW_TYPE_FLOAT, &m_mutationRate, "min=0 max=1 step=0.01 group=Evolution");
+  vars->addRW(bar, "GeneMutRate", TW_TYPE_FLOAT, &m_mutationGeneRate, "min=0 max=1 step=0.01 group=Evolution");
+  vars->addRW(bar, "Elites", TW_TYPE_INT32, &m_numElites, "min=0 max=100 group=Evolution");
 }
 
 void EvolutionProcess::computeNewPopulation(const std::vector<Chromosome*>& population, std::vector<Chromosome*>& newPopulation)
@@ -40,8 +41,20 @@ void EvolutionProcess::computeNewPopulation(const std::vector<Chromosome*>& popu
   for (size_t i = 0; i < n; ++i)
     totalFitness += population[i]->fitness();
 
+  // elitism: copy best chromosomes unchanged
+  size_t numElites = std::min(static_cast<size_t>(std::max(m_numElites, 0)), n);
+  if (numElites)
+  {
+    std::vector<Chromosome*> sorted(population);
+    std::partial_sort(sorted.begin(), sorted.begin() + numElites, sorted.end(), 
+      [](const Chromosome* a, const Chromosome* b) {return a->fitness() > b->fitness(); });
+
+    for (size_t i = 0; i < numElites; ++i)
+      newPopulation[i]->assign(sorted[i]);
+  }
+
   // genetic algorithm
-  for (size_t i = 0; i<n/2+1; ++i)
+  for (size_t i = 0; i<(n - numElites)/2+1; ++i)
   {
     // select two chromosomes for crossover
     Chromosome* a = 0;
@@ -49,7 +62,7 @@ void EvolutionProcess::computeNewPopulation(const std::vector<Chromosome*>& popu
     selection(population, totalFitness, &a, &b);
 
     // apply genetic operations
-    size_t indexA = i*2, indexB = i*2+1;
+    size_t indexA = numElites + i*2, indexB = numElites + i*2+1;
     if (indexA >= newPopulation.size()) 
       break;
     Chromosome* newA = newPopulation[indexA];
@@ -3,6 +3,8 @@
 #include <vector>
 #include <AntTweakBar.h>
 
+#include "../TweakVars.h"
+
 // steps of a genetic algorithm
 // - initialization
 // - selection based on fitness
@@ -15,11 +17,11 @@
 class EvolutionProcess
 {
 public:
-  EvolutionProcess(float chromosomeCrossRate, float chromosomeMutationRate, float geneMutationRate);
+  EvolutionProcess(float chromosomeCrossRate, float chromosomeMutationRate, float geneMutationRate, int numElites = 0);
   virtual ~EvolutionProcess();
 
 
-  void initTweakVars(TwBar* bar);
+  void initTweakVars(TwBar* bar, TweakVars* vars);
 
   struct Chromosome
   {
@@ -33,16 +35,23 @@ public:
     // prob is the probability of mutating a gene.
     virtual void mutate(float prob) = 0;
 
+    // copy genes of other chromosome
+    virtual void assign(const Chromosome* other) = 0;
+
     virtual float fitness() const = 0;
   };
 
   // apply genetic algorithm to compute a new population
   // newPopulation has to be allocated and different from population.
+  // The fittest numElites chromosomes are carried over unchanged to the front of newPopulation.
   void computeNewPopulation(const std::vector<Chromosome*>& population, std::vector<Chromosome*>& newPopulation);
 
   // get current generation id
   int generation() const { return m_generation; }
 
+  int numElites() const { return m_numElites; }
+  void numElites(int n) { m_numElites = n; }
+
 private:
 
   // select two chromosomes for crossover
@@ -61,4 +70,7 @@ private:
 
   // probability of mutating a gene
   float m_mutationGeneRate;
+
+  // number of best chromosomes surviving unchanged
+  int m_numElites;
 };
\ No newline at end of file
@@ -0,0 +1,172 @@
+#include "EvolutionStrategy.h"
+
+#include <cmath>
+#include <algorithm>
+#include <numeric>
+#include <iostream>
+
+EvolutionStrategy::EvolutionStrategy(float sigma, float learningRate, unsigned int seed)
+  : m_generation(0), m_sigma(sigma), m_learningRate(learningRate), m_rng(seed)
+{
+
+}
+
+EvolutionStrategy::~EvolutionStrategy()
+{
+}
+
+void EvolutionStrategy::initTweakVars(TwBar* bar, TweakVars* vars)
+{
+  vars->addRW(bar, "ESSigma", TW_TYPE_FLOAT, &m_sigma, "min=0 max=10 step=0.01 group=Evolution");
+  vars->addRW(bar, "ESLearnRate", TW_TYPE_FLOAT, &m_learningRate, "min=0 max=10 step=0.001 group=Evolution");
+}
+
+void EvolutionStrategy::computeNewPopulation(const std::vector<std::vector<float>*>& genes, const std::vector<float>& fitness)
+{
+  size_t n = genes.size();
+
+  if (n != fitness.size() || !n)
+  {
+    std::cerr << "error: genes and fitness size must be equal" << std::endl;
+    return;
+  }
+
+  if (!initialized() || m_population.size() != n)
+  {
+    // start search from fittest individual
+    size_t best = std::max_element(fitness.begin(), fitness.end()) - fitness.begin();
+    init(*genes[best]);
+  }
+  else
+    update(m_population, fitness);
+
+  samplePopulation(static_cast<int>(n), m_population);
+
+  for (size_t i = 0; i < n; ++i)
+    decode(m_population[i], *genes[i]);
+}
+
+const std::vector<float>& EvolutionStrategy::noiseTable()
+{
+  static std::vector<float> table;
+
+  if (table.empty())
+  {
+    // fixed seed: noise offsets are valid across processes
+    std::mt19937 rng(12345u);
+    std::normal_distribution<float> dist(0.0f, 1.0f);
+
+    table.resize(noiseTableSize());
+    std::generate(table.begin(), table.end(), [&rng, &dist] {return dist(rng); });
+  }
+
+  return table;
+}
+
+void EvolutionStrategy::init(const std::vector<float>& parent)
+{
+  m_parent = parent;
+  m_generation = 0;
+
+  if (m_parent.size() >= static_cast<size_t>(noiseTableSize()))
+    std::cerr << "error: genome larger than noise table" << std::endl;
+}
+
+void EvolutionStrategy::samplePopulation(int n, std::vector<Individual>& population)
+{
+  population.resize(n);
+
+  int maxSeed = noiseTableSize() - static_cast<int>(m_parent.size());
+  std::uniform_int_distribution<int> dist(0, std::max(maxSeed, 0));
+
+  // antithetic pairs
+  for (int i = 0; i + 1 < n; i += 2)
+  {
+    int seed = dist(m_rng);
+
+    population[i] = Individual(m_generation, seed, m_sigma);
+    population[i + 1] = Individual(m_generation, seed, -m_sigma);
+  }
+
+  // keep evaluating the parent if there is an odd slot left
+  if (n % 2)
+    population[n - 1] = Individual(m_generation, 0, 0.0f);
+}
+
+bool EvolutionStrategy::decode(const Individual& ind, std::vector<float>& genes) const
+{
+  if (ind.parent != m_generation)
+  {
+    std::cerr << "error: individual refers to outdated parent" << std::endl;
+    return false;
+  }
+
+  size_t n = m_parent.size();
+  genes.resize(n);
+
+  const float* eps = noiseTable().data() + ind.seed;
+  const float* theta = m_parent.data();
+  float sigma = ind.sigma;
+
+  for (size_t i = 0; i < n; ++i)
+    genes[i] = theta[i] + sigma * eps[i];
+
+  return true;
+}
+
+void EvolutionStrategy::update(const std::vector<Individual>& population, const std::vector<float>& fitness)
+{
+  size_t n = population.size();
+
+  if (n != fitness.size())
+  {
+    std::cerr << "error: population and fitness size must be equal" << std::endl;
+    return;
+  }
+
+  // fitness shaping: centered ranks in [-0.5, 0.5]
+  m_ranks.resize(n);
+  std::iota(m_ranks.begin(), m_ranks.end(), 0);
+  std::sort(m_ranks.begin(), m_ranks.end(), [&fitness](int a, int b) {return fitness[a] < fitness[b]; });
+
+  std::vector<float> shaped(n, 0.0f);
+  for (size_t i = 0; i < n; ++i)
+    shaped[m_ranks[i]] = n > 1 ? static_cast<float>(i) / (n - 1) - 0.5f : 0.0f;
+
+  // gradient estimate: sum_i F_i * eps_i / (n * sigma)
+  size_t ng = m_parent.size();
+  m_gradient.assign(ng, 0.0f);
+
+  int numPerturbed = 0;
+  float sigma = 0.0f;
+
+  for (size_t k = 0; k < n; ++k)
+  {
+    const Individual& ind = population[k];
+    if (ind.sigma == 0.0f || ind.parent != m_generation)
+      continue;
+
+    float w = ind.sigma > 0.0f ? shaped[k] : -shaped[k];
+    const float* eps = noiseTable().data() + ind.seed;
+    float* g = m_gradient.data();
+
+    for (size_t i = 0; i < ng; ++i)
+      g[i] += w * eps[i];
+
+    sigma = std::fabs(ind.sigma);
+    ++numPerturbed;
+  }
+
+  if (numPerturbed)
+  {
+    float step = m_learningRate / (numPerturbed * sigma);
+
+    float* theta = m_parent.data();
+    const float* g = m_gradient.data();
+
+    for (size_t i = 0; i < ng; ++i)
+      theta[i] += step * g[i];
+  }
+
+  ++m_generation;
+}
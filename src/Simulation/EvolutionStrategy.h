@@ -0,0 +1,92 @@
+#pragma once
+
+#include "Optimizer.h"
+
+#include <vector>
+#include <random>
+#include <AntTweakBar.h>
+
+// OpenAI-ES style evolution strategy
+// - a single parent weight vector (center of the search distribution)
+// - individuals are perturbations parent + sigma * noise[seed .. seed+n]
+//   taken from a noise table shared by all instances
+// - antithetic sampling: perturbations come in mirrored pairs (+sigma, -sigma)
+// - update: gradient estimate from centered fitness ranks
+
+
+
+
+class EvolutionStrategy : public Optimizer
+{
+public:
+  EvolutionStrategy(float sigma, float learningRate, unsigned int seed = 0);
+  virtual ~EvolutionStrategy();
+
+
+  void initTweakVars(TwBar* bar, TweakVars* vars);
+
+  // Optimizer interface: update parent from the evaluated population,
+  // then sample and decode the next one. The first call starts from the fittest genes.
+  void computeNewPopulation(const std::vector<std::vector<float>*>& genes, const std::vector<float>& fitness);
+
+  // compact encoding of an individual, a population of thousands
+  // needs the parent weight vector only plus these integers
+  struct Individual
+  {
+    Individual() : parent(0), seed(0), sigma(0.0f) {}
+    Individual(int p, int s, float sig) : parent(p), seed(s), sigma(sig) {}
+
+    int parent; // generation of the parent weight vector
+    int seed;   // offset into the shared noise table
+    float sigma; // signed perturbation scale, 0 is the unperturbed parent
+  };
+
+  // set the parent weight vector, resets generation counter
+  void init(const std::vector<float>& parent);
+
+  bool initialized() const { return !m_parent.empty(); }
+
+  // sample population of n individuals around the current parent.
+  // if n is odd, the last individual is the parent itself.
+  void samplePopulation(int n, std::vector<Individual>& population);
+
+  // expand individual to full weight vector
+  bool decode(const Individual& ind, std::vector<float>& genes) const;
+
+  // move parent along the estimated fitness gradient of the sampled population
+  void update(const std::vector<Individual>& population, const std::vector<float>& fitness);
+
+  const std::vector<float>& parent() const { return m_parent; }
+
+  // get current generation id
+  int generation() const { return m_generation; }
+
+
+  // noise table shared by all instances, generated once from a fixed seed
+  static const std::vector<float>& noiseTable();
+  static int noiseTableSize() { return 1 << 20; }
+
+private:
+
+  // generation counter
+  int m_generation;
+
+  // standard deviation of perturbations
+  float m_sigma;
+
+  // step size of parent update
+  float m_learningRate;
+
+  // current parent weights
+  std::vector<float> m_parent;
+
+  // random offsets into noise table
+  std::mt19937 m_rng;
+
+  // population handed out by computeNewPopulation
+  std::vector<Individual> m_population;
+
+  // temporary storage
+  std::vector<int> m_ranks;
+  std::vector<float> m_gradient;
+};
@@ -0,0 +1,119 @@
+#include "GeneticAlgorithm.h"
+
+#include <cstdlib>
+#include <algorithm>
+#include <iostream>
+
+
+struct GeneticAlgorithm::Individual : public EvolutionProcess::Chromosome
+{
+  Individual(const float* _mutationMaxChange) : value(0.0f), mutationMaxChange(_mutationMaxChange) {}
+
+  void crossover(const EvolutionProcess::Chromosome* _other, float prob, EvolutionProcess::Chromosome* _resultA, EvolutionProcess::Chromosome* _resultB) const
+  {
+    const Individual* other = dynamic_cast<const Individual*>(_other);
+    Individual* resultA = dynamic_cast<Individual*>(_resultA);
+    Individual* resultB = dynamic_cast<Individual*>(_resultB);
+
+    size_t n = genes.size();
+
+    for (size_t i = 0; i < n; ++i)
+    {
+      const Individual* a = this;
+      const Individual* b = other;
+
+      float u = static_cast<float>(std::rand()) / RAND_MAX;
+      if (u < prob)
+        std::swap(a, b);
+
+      resultA->genes[i] = a->genes[i];
+      if (resultB)
+        resultB->genes[i] = b->genes[i];
+    }
+  }
+
+  void mutate(float prob)
+  {
+    size_t n = genes.size();
+
+    for (size_t i = 0; i < n; ++i)
+    {
+      float u = static_cast<float>(std::rand()) / RAND_MAX;
+      if (u < prob)
+      {
+        float m = static_cast<float>(std::rand()) / RAND_MAX * 2.0f - 1.0f;
+        genes[i] += m * *mutationMaxChange;
+      }
+    }
+  }
+
+  void assign(const EvolutionProcess::Chromosome* other)
+  {
+    genes = dynamic_cast<const Individual*>(other)->genes;
+  }
+
+  float fitness() const { return value; }
+
+
+  std::vector<float> genes;
+  float value;
+
+  const float* mutationMaxChange;
+};
+
+
+GeneticAlgorithm::GeneticAlgorithm(float chromosomeCrossRate, float chromosomeMutationRate, float geneMutationRate, int numElites)
+  : m_evolution(chromosomeCrossRate, chromosomeMutationRate, geneMutationRate, numElites), m_mutationMaxChange(0.6f)
+{
+
+}
+
+GeneticAlgorithm::~GeneticAlgorithm()
+{
+  for (size_t i = 0; i < m_population.size(); ++i)
+  {
+    delete m_population[i];
+    delete m_populationNext[i];
+  }
+}
+
+void GeneticAlgorithm::initTweakVars(TwBar* bar, TweakVars* vars)
+{
+  m_evolution.initTweakVars(bar, vars);
+
+  vars->addRW(bar, "MutChange", TW_TYPE_FLOAT, &m_mutationMaxChange, "min=0 max=10 step=0.01 group=Evolution");
+}
+
+void GeneticAlgorithm::computeNewPopulation(const std::vector<std::vector<float>*>& genes, const std::vector<float>& fitness)
+{
+  size_t n = genes.size();
+
+  if (n != fitness.size() || !n)
+  {
+    std::cerr << "error: GeneticAlgorithm population and fitness size must be equal and non-zero" << std::endl;
+    return;
+  }
+
+  while (m_population.size() < n)
+  {
+    m_population.push_back(new Individual(&m_mutationMaxChange));
+    m_populationNext.push_back(new Individual(&m_mutationMaxChange));
+  }
+
+  std::vector<EvolutionProcess::Chromosome*> population(n), populationNext(n);
+
+  for (size_t i = 0; i < n; ++i)
+  {
+    m_population[i]->genes = *genes[i];
+    m_population[i]->value = fitness[i];
+    m_populationNext[i]->genes.resize(genes[i]->size());
+
+    population[i] = m_population[i];
+    populationNext[i] = m_populationNext[i];
+  }
+
+  m_evolution.computeNewPopulation(population, populationNext);
+
+  for (size_t i = 0; i < n; ++i)
+    *genes[i] = m_populationNext[i]->genes;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Optimizer.h"
+#include "Evolution.h"
+
+#include <vector>
+#include <AntTweakBar.h>
+
+// genetic algorithm on gene vectors, Optimizer front end of EvolutionProcess
+// - roulette wheel selection proportional to fitness
+// - uniform crossover, mutation adds uniform noise of up to mutationMaxChange to a gene
+// - the fittest numElites individuals survive unchanged
+
+
+
+
+class GeneticAlgorithm : public Optimizer
+{
+public:
+  GeneticAlgorithm(float chromosomeCrossRate, float chromosomeMutationRate, float geneMutationRate, int numElites = 0);
+  virtual ~GeneticAlgorithm();
+
+
+  void initTweakVars(TwBar* bar, TweakVars* vars);
+
+  // Optimizer interface: selection and genetic operations on the evaluated population
+  void computeNewPopulation(const std::vector<std::vector<float>*>& genes, const std::vector<float>& fitness);
+
+  int generation() const { return m_evolution.generation(); }
+
+private:
+
+  struct Individual;
+
+  EvolutionProcess m_evolution;
+
+  // max change of a mutated gene
+  float m_mutationMaxChange;
+
+  std::vector<Individual*> m_population;
+  std::vector<Individual*> m_populationNext;
+};
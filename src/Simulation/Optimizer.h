@@ -0,0 +1,32 @@
+#pragma once
+
+#include <vector>
+#include <AntTweakBar.h>
+
+#include "../TweakVars.h"
+
+// interface for black-box optimizers working directly on gene vectors
+// (GeneticAlgorithm, EvolutionStrategy, CmaEvolutionStrategy)
+// - the simulation evaluates the population and passes genes + fitness
+// - the optimizer replaces the genes with the next population to evaluate
+
+
+
+
+class Optimizer
+{
+public:
+  Optimizer() {}
+  virtual ~Optimizer() {}
+
+
+  virtual void initTweakVars(TwBar* bar, TweakVars* vars) {}
+
+  // Compute next population.
+  // genes: weight vectors of the evaluated population, overwritten with the new population.
+  // fitness: fitness of each evaluated individual, higher is better.
+  virtual void computeNewPopulation(const std::vector<std::vector<float>*>& genes, const std::vector<float>& fitness) = 0;
+
+  // get current generation id
+  virtual int generation() const = 0;
+};
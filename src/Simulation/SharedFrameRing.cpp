@@ -0,0 +1,410 @@
+#include "SharedFrameRing.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+// layout of the object: header, then numSlots slots of slotSize bytes each starting with the slot header.
+// only 32 bit atomics are used, loads of those do not write even where wider atomics would
+struct SharedFrameRing::Header
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t numSlots;
+  uint32_t slotSize;
+
+  // number of frames written, frame n is in slot n % numSlots
+  std::atomic<uint32_t> numWritten;
+};
+
+struct SharedFrameRing::Slot
+{
+  // 2n + 1 while frame n is written, 2n + 2 once complete
+  std::atomic<uint32_t> sequence;
+  uint32_t size;
+};
+
+namespace
+{
+  const uint32_t RingMagic = 0x52464c44; // 'DLFR'
+  const uint32_t RingVersion = 1;
+
+  // both are padded to 16 bytes
+  const size_t HeaderSize = 32;
+  const size_t SlotHeaderSize = 16;
+
+
+  // sequential copy of plain values into a byte range, fails if the range is too small
+  struct Writer
+  {
+    unsigned char* p;
+    unsigned char* end;
+
+    template <typename T>
+    bool put(const T& v)
+    {
+      if (p + sizeof(T) > end)
+        return false;
+      std::memcpy(p, &v, sizeof(T));
+      p += sizeof(T);
+      return true;
+    }
+
+    bool putTransform(const btTransform& t)
+    {
+      float m[12];
+      for (int r = 0; r < 3; ++r)
+      {
+        for (int c = 0; c < 3; ++c)
+          m[r * 3 + c] = t.getBasis()[r][c];
+        m[9 + r] = t.getOrigin()[r];
+      }
+      return put(m);
+    }
+
+    bool putVector(const btVector3& v)
+    {
+      float m[3] = { v.x(), v.y(), v.z() };
+      return put(m);
+    }
+  };
+
+  struct Reader
+  {
+    const unsigned char* p;
+    const unsigned char* end;
+
+    template <typename T>
+    bool get(T* v)
+    {
+      if (p + sizeof(T) > end)
+        return false;
+      std::memcpy(v, p, sizeof(T));
+      p += sizeof(T);
+      return true;
+    }
+
+    bool getTransform(btTransform* t)
+    {
+      float m[12];
+      if (!get(&m))
+        return false;
+      t->setBasis(btMatrix3x3(m[0], m[1], m[2], m[3], m[4], m[5], m[6], m[7], m[8]));
+      t->setOrigin(btVector3(m[9], m[10], m[11]));
+      return true;
+    }
+
+    bool getVector(btVector3* v)
+    {
+      float m[3];
+      if (!get(&m))
+        return false;
+      v->setValue(m[0], m[1], m[2]);
+      return true;
+    }
+  };
+
+  // fixed part, then 16 floats per box and 3 per sensor line point
+  const size_t FrameFixedSize = 8 + 6 * 4 + 12 * 4 + 2 * 4;
+  const size_t FrameBoxSize = 16 * 4;
+  const size_t FrameLinePointSize = 3 * 4;
+
+  bool serialize(const SimulationFrame& frame, Writer* w)
+  {
+    bool ok = w->put(frame.time)
+      && w->put(static_cast<int32_t>(frame.generation))
+      && w->put(static_cast<int32_t>(frame.numVehiclesAlive))
+      && w->put(frame.bestDistance)
+      && w->put(frame.avgDistance)
+      && w->put(static_cast<int32_t>(frame.sensorsPerVehicle))
+      && w->put(static_cast<int32_t>(frame.hasFollowTarget))
+      && w->putTransform(frame.followTarget)
+      && w->put(static_cast<int32_t>(frame.boxes.size()))
+      && w->put(static_cast<int32_t>(frame.sensorLines.size()));
+
+    for (size_t i = 0; ok && i < frame.boxes.size(); ++i)
+    {
+      const SimulationFrame::Box& box = frame.boxes[i];
+      ok = w->putTransform(box.transform) && w->putVector(box.size) && w->put(static_cast<int32_t>(box.type));
+    }
+
+    for (size_t i = 0; ok && i < frame.sensorLines.size(); ++i)
+      ok = w->putVector(frame.sensorLines[i]);
+
+    return ok;
+  }
+
+  bool deserialize(Reader* r, SimulationFrame* frame)
+  {
+    int32_t generation, numAlive, sensorsPerVehicle, hasFollowTarget, numBoxes, numLinePoints;
+
+    bool ok = r->get(&frame->time)
+      && r->get(&generation)
+      && r->get(&numAlive)
+      && r->get(&frame->bestDistance)
+      && r->get(&frame->avgDistance)
+      && r->get(&sensorsPerVehicle)
+      && r->get(&hasFollowTarget)
+      && r->getTransform(&frame->followTarget)
+      && r->get(&numBoxes)
+      && r->get(&numLinePoints);
+
+    if (!ok || numBoxes < 0 || numLinePoints < 0)
+      return false;
+
+    frame->generation = generation;
+    frame->numVehiclesAlive = numAlive;
+    frame->sensorsPerVehicle = sensorsPerVehicle;
+    frame->hasFollowTarget = hasFollowTarget != 0;
+
+    frame->boxes.resize(numBoxes);
+    for (int32_t i = 0; ok && i < numBoxes; ++i)
+    {
+      SimulationFrame::Box& box = frame->boxes[i];
+      int32_t type;
+      ok = r->getTransform(&box.transform) && r->getVector(&box.size) && r->get(&type);
+      box.type = type;
+    }
+
+    frame->sensorLines.resize(numLinePoints);
+    for (int32_t i = 0; ok && i < numLinePoints; ++i)
+      ok = r->getVector(&frame->sensorLines[i]);
+
+    return ok;
+  }
+
+#ifndef _WIN32
+  // POSIX names start with a slash
+  std::string shmName(const std::string& name)
+  {
+    return name.empty() || name[0] != '/' ? "/" + name : name;
+  }
+#endif
+}
+
+
+SharedFrameRing::SharedFrameRing()
+  : m_writer(false), m_base(0), m_size(0),
+#ifdef _WIN32
+  m_mapping(0),
+#else
+  m_fd(-1),
+#endif
+  m_lastRead(0)
+{
+}
+
+SharedFrameRing::~SharedFrameRing()
+{
+  close();
+}
+
+bool SharedFrameRing::create(const std::string& name, int numSlots, size_t slotSize)
+{
+  close();
+
+  if (numSlots < 2)
+    numSlots = 2;
+  slotSize = (SlotHeaderSize + slotSize + 15) & ~static_cast<size_t>(15);
+
+  size_t size = HeaderSize + numSlots * slotSize;
+
+#ifdef _WIN32
+  std::string winName = "Local\\" + name;
+  m_mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+    static_cast<DWORD>(static_cast<uint64_t>(size) >> 32), static_cast<DWORD>(size), winName.c_str());
+  if (m_mapping)
+    m_base = reinterpret_cast<unsigned char*>(MapViewOfFile(m_mapping, FILE_MAP_ALL_ACCESS, 0, 0, size));
+#else
+  // readers still attached to an old object keep it until they detach
+  shm_unlink(shmName(name).c_str());
+
+  m_fd = shm_open(shmName(name).c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  if (m_fd >= 0 && ftruncate(m_fd, size) == 0)
+  {
+    void* p = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    m_base = p != MAP_FAILED ? reinterpret_cast<unsigned char*>(p) : 0;
+  }
+#endif
+
+  m_name = name;
+  m_writer = true;
+
+  if (!m_base)
+  {
+    std::cerr << "error: could not create shared memory " << name << std::endl;
+    close();
+    return false;
+  }
+  m_size = size;
+
+  // mapping is zero filled, magic is set last so readers never see a partial header
+  Header* h = header();
+  h->version = RingVersion;
+  h->numSlots = numSlots;
+  h->slotSize = static_cast<uint32_t>(slotSize);
+  h->numWritten.store(0);
+  std::atomic_thread_fence(std::memory_order_release);
+  h->magic = RingMagic;
+
+  return true;
+}
+
+bool SharedFrameRing::attach(const std::string& name)
+{
+  close();
+
+#ifdef _WIN32
+  std::string winName = "Local\\" + name;
+  m_mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, winName.c_str());
+  if (m_mapping)
+  {
+    m_base = reinterpret_cast<unsigned char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+
+    MEMORY_BASIC_INFORMATION info;
+    if (m_base && VirtualQuery(m_base, &info, sizeof(info)))
+      m_size = info.RegionSize;
+  }
+#else
+  m_fd = shm_open(shmName(name).c_str(), O_RDONLY, 0);
+
+  struct stat st;
+  if (m_fd >= 0 && fstat(m_fd, &st) == 0 && st.st_size > 0)
+  {
+    void* p = mmap(0, st.st_size, PROT_READ, MAP_SHARED, m_fd, 0);
+    m_base = p != MAP_FAILED ? reinterpret_cast<unsigned char*>(p) : 0;
+    m_size = st.st_size;
+  }
+#endif
+
+  m_name = name;
+  m_writer = false;
+  m_lastRead = 0;
+
+  // the writer may still be setting up the header
+  Header* h = m_base && m_size >= HeaderSize ? header() : 0;
+  bool ok = h && h->magic == RingMagic && h->version == RingVersion && h->numSlots > 0
+    && HeaderSize + static_cast<size_t>(h->numSlots) * h->slotSize <= m_size;
+
+  if (!ok)
+  {
+    close();
+    return false;
+  }
+
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return true;
+}
+
+void SharedFrameRing::close()
+{
+#ifdef _WIN32
+  if (m_base)
+    UnmapViewOfFile(m_base);
+  if (m_mapping)
+    CloseHandle(m_mapping);
+  m_mapping = 0;
+#else
+  if (m_base)
+    munmap(m_base, m_size);
+  if (m_fd >= 0)
+    ::close(m_fd);
+  if (m_fd >= 0 && m_writer)
+    shm_unlink(shmName(m_name).c_str());
+  m_fd = -1;
+#endif
+
+  m_base = 0;
+  m_size = 0;
+  m_writer = false;
+}
+
+size_t SharedFrameRing::frameSize(const SimulationFrame& frame)
+{
+  return FrameFixedSize + frame.boxes.size() * FrameBoxSize + frame.sensorLines.size() * FrameLinePointSize;
+}
+
+bool SharedFrameRing::write(const SimulationFrame& frame)
+{
+  if (!m_base || !m_writer)
+    return false;
+
+  Header* h = header();
+  uint32_t n = h->numWritten.load(std::memory_order_relaxed);
+  Slot* s = slot(n % h->numSlots);
+
+  s->sequence.store(2 * n + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  unsigned char* payload = reinterpret_cast<unsigned char*>(s) + SlotHeaderSize;
+  Writer w = { payload, reinterpret_cast<unsigned char*>(s) + h->slotSize };
+
+  if (!serialize(frame, &w))
+  {
+    // slot stays marked as being written, readers skip it
+    return false;
+  }
+  s->size = static_cast<uint32_t>(w.p - payload);
+
+  s->sequence.store(2 * n + 2, std::memory_order_release);
+  h->numWritten.store(n + 1, std::memory_order_release);
+
+  return true;
+}
+
+bool SharedFrameRing::read(SimulationFrame* frame)
+{
+  if (!m_base)
+    return false;
+
+  Header* h = header();
+  uint32_t n = h->numWritten.load(std::memory_order_acquire);
+  if (n == 0 || n == m_lastRead)
+    return false;
+
+  Slot* s = slot((n - 1) % h->numSlots);
+
+  uint32_t sequence = s->sequence.load(std::memory_order_acquire);
+  if (sequence != 2 * (n - 1) + 2)
+    return false;
+
+  uint32_t size = s->size;
+  if (size > h->slotSize - SlotHeaderSize)
+    return false;
+
+  m_buffer.resize(size);
+  std::memcpy(m_buffer.data(), reinterpret_cast<unsigned char*>(s) + SlotHeaderSize, size);
+
+  // slot was overwritten during the copy
+  std::atomic_thread_fence(std::memory_order_acquire);
+  if (s->sequence.load(std::memory_order_relaxed) != sequence)
+    return false;
+
+  m_lastRead = n;
+
+  Reader r = { m_buffer.data(), m_buffer.data() + m_buffer.size() };
+  return deserialize(&r, frame);
+}
+
+SharedFrameRing::Header* SharedFrameRing::header() const
+{
+  return reinterpret_cast<Header*>(m_base);
+}
+
+SharedFrameRing::Slot* SharedFrameRing::slot(unsigned int i) const
+{
+  return reinterpret_cast<Slot*>(m_base + HeaderSize + static_cast<size_t>(i) * header()->slotSize);
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "SimulationFrame.h"
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+
+// Ring of serialized SimulationFrames in a named shared memory object, to watch a training process from another one.
+// One writer creates the object and never waits, readers map it read-only and take the newest complete frame.
+// Each slot is guarded by a sequence number, a reader that loses the race against the writer skips the frame,
+// so a reader can neither block nor corrupt the writer.
+// Uses POSIX shm_open/mmap, file mappings of the paging file on Windows.
+class SharedFrameRing
+{
+public:
+
+  SharedFrameRing();
+  virtual ~SharedFrameRing();
+
+
+  // writer: create object with numSlots slots of slotSize bytes, replaces an existing object of the same name
+  bool create(const std::string& name, int numSlots, size_t slotSize);
+
+  // reader: map existing object read-only
+  bool attach(const std::string& name);
+
+  // unmap, the writer also removes the name
+  void close();
+
+  bool valid() const { return m_base != 0; }
+
+
+  // bytes of frame in a slot, without previous step data
+  static size_t frameSize(const SimulationFrame& frame);
+
+  // writer: returns false if the frame does not fit into a slot
+  bool write(const SimulationFrame& frame);
+
+  // reader: newest frame if it was not read before.
+  // returns false if there is none or the writer overwrote it while reading
+  bool read(SimulationFrame* frame);
+
+private:
+
+  struct Header;
+  struct Slot;
+
+  Header* header() const;
+  Slot* slot(unsigned int i) const;
+
+private:
+
+  std::string m_name;
+  bool m_writer;
+
+  unsigned char* m_base;
+  size_t m_size;
+
+#ifdef _WIN32
+  void* m_mapping;
+#else
+  int m_fd;
+#endif
+
+  // reader: frame count at last read and copy of the slot
+  unsigned int m_lastRead;
+  std::vector<unsigned char> m_buffer;
+};
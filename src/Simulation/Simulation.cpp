@@ -2,6 +2,9 @@
 #include <glad/glad.h>
 
 #include "Simulation.h"
+#include "GeneticAlgorithm.h"
+#include "EvolutionStrategy.h"
+#include "CmaEvolutionStrategy.h"
 
 
 #include <BulletCollision/CollisionShapes/btHeightfieldTerrainShape.h>
@@ -12,11 +15,37 @@
 #include <fstream>
 #include <algorithm>
 #include <sstream>
+#include <cmath>
+
+// default group/mask filtering, but no pairs between vehicles and the track body
+struct TrackOverlapFilter : public btOverlapFilterCallback
+{
+  TrackOverlapFilter(btRigidBody* track) : m_track(track) {}
+
+  virtual bool needBroadphaseCollision(btBroadphaseProxy* proxy0, btBroadphaseProxy* proxy1) const
+  {
+    bool collides = (proxy0->m_collisionFilterGroup & proxy1->m_collisionFilterMask) != 0;
+    collides = collides && (proxy1->m_collisionFilterGroup & proxy0->m_collisionFilterMask);
+
+    if (!collides)
+      return false;
+
+    if (proxy1->m_clientObject == m_track)
+      std::swap(proxy0, proxy1);
+
+    return proxy0->m_clientObject != m_track || !(proxy1->m_collisionFilterGroup & Vehicle::collisionGroup());
+  }
+
+  btRigidBody* m_track;
+};
+
 
 Simulation::Simulation(INIReader* settings, Application* app)
   : m_settings(settings), m_app(app), m_bullet(0), m_groundBody(0), m_sphereBody(0), m_vehicleUser(0),
   m_avgDrivenDistance(0.0f), m_bestDrivenDistance(0.0f), m_numVehiclesAlive(0),
-  m_evolution(0), m_trackBody(0)
+  m_generationTime(0.0), m_raceNextRung(0.0), m_raceRung(0), m_numSteps(0), m_numGenerations(0),
+  m_saveSnapshotRequest(false), m_restoreSnapshotRequest(false), m_snapshotSource(-1), m_snapshotGenerationTime(0.0), m_snapshotNumSteps(0), m_snapshotRaceNextRung(0.0), m_snapshotRaceRung(0), m_branchRollouts(false),
+  m_optimizer(0), m_trackHeightfield(0), m_trackDistanceField(0), m_heightfieldSensors(false), m_trackBody(0), m_trackFilter(0)
 {
 
   m_desc.numCars = settings->GetInteger("simulation", "numCars", 20);
@@ -25,8 +54,28 @@ Simulation::Simulation(INIReader* settings, Application* app)
   m_desc.trackScale = static_cast<float>(settings->GetReal("track", "scale", 2.0));
   m_desc.trackGroundLevel = static_cast<float>(settings->GetReal("track", "groundLevel", 1.0));
   m_desc.restartLap = settings->GetInteger("simulation", "restartLap", 1);
+  m_desc.racing = settings->GetBoolean("simulation", "racing", false);
+  // rungs have to advance in time and keep at least some vehicles
+  m_desc.racingHorizon = std::max(static_cast<float>(settings->GetReal("simulation", "racingHorizon", 5.0)), 0.01f);
+  m_desc.racingHorizonGrowth = std::max(static_cast<float>(settings->GetReal("simulation", "racingHorizonGrowth", 2.0)), 1.0f);
+  m_desc.racingKeepFraction = std::min(std::max(static_cast<float>(settings->GetReal("simulation", "racingKeepFraction", 0.5)), 0.01f), 1.0f);
+  m_desc.fitnessCache = settings->GetBoolean("evolution", "fitnessCache", false);
+  m_raceNextRung = m_desc.racingHorizon;
+  m_desc.controlInterval = std::max(static_cast<int>(settings->GetInteger("simulation", "controlInterval", 1)), 1);
+  m_desc.analyticTrackCollision = settings->GetBoolean("simulation", "analyticTrackCollision", false);
+  m_desc.bicycleGenerations = static_cast<int>(settings->GetInteger("simulation", "bicycleGenerations", 0));
+
+  std::string vehicleDynamics = settings->Get("simulation", "vehicleDynamics", "bullet");
+  if (vehicleDynamics == "batched")
+    m_desc.vehicleDynamics = BulletInterface::BatchedRaycastVehicles;
+  else if (vehicleDynamics == "bicycle")
+    m_desc.vehicleDynamics = BulletInterface::BicycleVehicles;
+  else
+    m_desc.vehicleDynamics = BulletInterface::RaycastVehicles;
   
-  m_bullet = new BulletInterface();
+  // vehicles never collide with each other, so a broadphase without dynamic-dynamic pairs suffices
+  m_bullet = new BulletInterface(settings->Get("simulation", "broadphase", "dbvt") == "staticSet",
+    m_desc.bicycleGenerations > 0 ? BulletInterface::BicycleVehicles : m_desc.vehicleDynamics, m_desc.numCars + 1);
   m_bullet->world->setGravity(btVector3(0, -10, 0));
 
   //m_groundBody = m_bullet->createManagedRigidBody(std::make_shared<btStaticPlaneShape>(btVector3(0, 1, 0), 1), 0.0, btVector3(0, -1, 0), false);
@@ -56,6 +105,8 @@ Simulation::Simulation(INIReader* settings, Application* app)
     m_vehicles[i]->initNeuralNetwork(internalNetworkLayers);
   }
 
+  updateControlPhases();
+
   
   // user controller vehicle
   if (settings->GetBoolean("simulation", "enableUserCar", false))
@@ -65,7 +116,20 @@ Simulation::Simulation(INIReader* settings, Application* app)
   }
 
 
-  m_evolution = new EvolutionProcess(0.25f, 0.5f, 0.1f);
+  std::string optimizer = settings->Get("evolution", "optimizer", "ga");
+  if (optimizer == "es")
+  {
+    float sigma = static_cast<float>(settings->GetReal("evolution", "esSigma", 0.1));
+    float learningRate = static_cast<float>(settings->GetReal("evolution", "esLearningRate", 0.05));
+    m_optimizer = new EvolutionStrategy(sigma, learningRate);
+  }
+  else if (optimizer == "cmaes")
+  {
+    float sigma = static_cast<float>(settings->GetReal("evolution", "cmaSigma", 0.3));
+    m_optimizer = new CmaEvolutionStrategy(sigma);
+  }
+  else
+    m_optimizer = new GeneticAlgorithm(0.25f, 0.5f, 0.1f, settings->GetInteger("evolution", "elites", 0));
 
 
   initTrack();
@@ -81,53 +145,73 @@ Simulation::~Simulation()
     if (m_vehicleUser)
     {
       m_bullet->world->removeRigidBody(m_vehicleUser->physics()->getRigidBody());
-      m_bullet->world->removeVehicle(m_vehicleUser->physics());
+      m_bullet->removeVehicle(m_vehicleUser->physics());
       delete m_vehicleUser;
     }
 
     delete m_bullet;
   }
 
+  delete m_trackFilter;
+
   for (size_t i = 0; i < m_vehicles.size(); ++i)
     delete m_vehicles[i];
 
   for (size_t i = 0; i < m_chromosomes.size(); ++i)
-  {
     delete m_chromosomes[i];
-    delete m_chromosomesNext[i];
-  }
 
-  delete m_evolution;
+  delete m_optimizer;
+  delete m_trackDistanceField;
+  delete m_trackHeightfield;
 }
 
 
 void Simulation::initTweakVars(TwBar* bar)
 {
-  if (m_evolution)
-    m_evolution->initTweakVars(bar);
-
-  TwAddVarRW(bar, "MutChange", TW_TYPE_FLOAT, &Vehicle::Chromosome::mutationMaxChange, "min=0 max=10 step=0.01 group=Evolution");
+  // the simulation may run on its own thread, tweak bar values are exchanged in update
+  m_optimizer->initTweakVars(bar, &m_tweakVars);
   
-  TwAddVarRO(bar, "BestDistance", TW_TYPE_FLOAT, &m_bestDrivenDistance, "group=Performance");
-  TwAddVarRO(bar, "AvgDistance", TW_TYPE_FLOAT, &m_avgDrivenDistance, "group=Performance");
-  TwAddVarRO(bar, "NumAlive", TW_TYPE_INT32, &m_numVehiclesAlive, "group=Performance");
+  // performance statistics are shown by the renderer from the published frames
+
+  TwAddButton(bar, "SaveState", saveSnapshotCallback, this, "group=Snapshot");
+  TwAddButton(bar, "RestoreState", restoreSnapshotCallback, this, "group=Snapshot");
+  m_tweakVars.addRW(bar, "BranchRollouts", TW_TYPE_BOOLCPP, &m_branchRollouts, "group=Snapshot");
 
 
   if (m_vehicleUser)
   {
-    TwAddVarRO(bar, "Distance", TW_TYPE_FLOAT, &m_vehicleUser->curTrackDistance(), "group=UserCar");
-    TwAddVarRO(bar, "Segment", TW_TYPE_INT32, &m_vehicleUser->curTrackSegment(), "group=UserCar");
-    TwAddVarRO(bar, "EntryTime", TW_TYPE_DOUBLE, &m_vehicleUser->curTrackSegmentEntryTime(), "group=UserCar");
-    TwAddVarRO(bar, "Lap", TW_TYPE_INT32, &m_vehicleUser->curLap(), "group=UserCar");
+    m_tweakVars.addRO(bar, "Distance", TW_TYPE_FLOAT, &m_vehicleUser->curTrackDistance(), "group=UserCar");
+    m_tweakVars.addRO(bar, "Segment", TW_TYPE_INT32, &m_vehicleUser->curTrackSegment(), "group=UserCar");
+    m_tweakVars.addRO(bar, "EntryTime", TW_TYPE_DOUBLE, &m_vehicleUser->curTrackSegmentEntryTime(), "group=UserCar");
+    m_tweakVars.addRO(bar, "Lap", TW_TYPE_INT32, &m_vehicleUser->curLap(), "group=UserCar");
   }
 }
 
+void TW_CALL Simulation::saveSnapshotCallback(void* clientData)
+{
+  static_cast<Simulation*>(clientData)->m_saveSnapshotRequest = true;
+}
+
+void TW_CALL Simulation::restoreSnapshotCallback(void* clientData)
+{
+  static_cast<Simulation*>(clientData)->m_restoreSnapshotRequest = true;
+}
+
 void Simulation::subtickCallback(btDynamicsWorld* world, btScalar timeStep)
 {
   // find and mark all vehicles colliding with the track
 
   Simulation* sim = static_cast<Simulation*>(world->getWorldUserInfo());
 
+  // bicycle chassis are not in the world and have no contacts
+  bool bicycle = sim->m_bullet->vehicleDynamics == BulletInterface::BicycleVehicles;
+
+  if (sim->m_trackFilter || (bicycle && sim->m_trackHeightfield))
+  {
+    sim->killTrackCollisions();
+    return;
+  }
+
   int numManifolds = world->getDispatcher()->getNumManifolds();
   for (int i = 0; i < numManifolds; i++)
   {
@@ -165,61 +249,263 @@ void Simulation::subtickCallback(btDynamicsWorld* world, btScalar timeStep)
   }
 }
 
+void Simulation::killTrackCollisions()
+{
+  for (int i = 0; i < numVehicles(); ++i)
+  {
+    Vehicle* v = vehicle(i);
+
+    if (!v->alive())
+      continue;
+
+    const btTransform& t = v->physics()->getRigidBody()->getWorldTransform();
+
+    for (size_t k = 0; k < m_vehicleChassisSamples.size(); ++k)
+    {
+      btVector3 p = t * m_vehicleChassisSamples[k];
+
+      btScalar height;
+      if (m_trackHeightfield->surfaceHeight(p[0], p[2], &height) && p[1] < height)
+      {
+        v->kill();
+        break;
+      }
+    }
+  }
+}
+
 void Simulation::update(double dt)
 {
-  // update bullet world
-  m_bullet->world->stepSimulation(static_cast<btScalar>(dt), 10);
+  m_tweakVars.sync();
+
+  if (m_saveSnapshotRequest.exchange(false))
+    saveSnapshot();
+
+  if (m_restoreSnapshotRequest.exchange(false))
+    restoreSnapshot();
+
+  // update bullet world, pairs and manifolds created on the way come from the world's arena
+  {
+    BulletArena::Scope scope(m_bullet->arena);
+    m_bullet->world->stepSimulation(static_cast<btScalar>(dt), 10);
+  }
+
+  m_generationTime += dt;
+
+  if (m_desc.racing && m_generationTime >= m_raceNextRung)
+    raceVehicles();
 
   // update evolution process
   m_numVehiclesAlive = 0;
   m_bestDrivenDistance = 0.0f;
 
   // update vehicle states
-  size_t n = m_vehicles.size();
+  int n = static_cast<int>(m_vehicles.size());
   for (int i = 0; i < n; ++i)
   {
-    Vehicle* v = m_vehicles[i];
-
-    if (v->alive())
+    if (m_vehicles[i]->alive())
     {
-      v->update(dt, this);
+      // vehicles take turns, so that sensor and controller load is spread evenly over steps
+      bool control = (m_numSteps + m_controlPhases[i]) % m_desc.controlInterval == 0;
 
+      m_vehicles[i]->update(dt, this, control);
+    }
+  }
+
+  // kill checks and statistics over the state store, ai vehicles are in the first n slots
+  VehicleStateStore& st = m_vehicleStates;
+  for (int i = 0; i < n; ++i)
+  {
+    if (st.alive[i])
+    {
       // kill vehicles in reverse dir
-      if (v->curTrackSegment() < 0)
-        v->kill();
+      if (st.curSegment[i] < 0)
+        st.alive[i] = 0;
 
       // kill vehicles that don't make any progress
-      if ((glfwGetTime() - v->curTrackSegmentEntryTime() > 10.0f))
-        v->kill();
+      if (m_generationTime - st.curSegmentEntryTime[i] > 10.0)
+        st.alive[i] = 0;
 
 
-      if (m_desc.restartLap == v->curLap())
-        v->kill();
+      if (m_desc.restartLap == st.curLap[i])
+        st.alive[i] = 0;
     }
 
-    if (v->alive())
+    if (st.alive[i])
     {
       ++m_numVehiclesAlive;
     }
     else
-      v->physics()->getRigidBody()->forceActivationState(DISABLE_SIMULATION);
+      m_vehicles[i]->physics()->getRigidBody()->forceActivationState(DISABLE_SIMULATION);
 
-    m_bestDrivenDistance = std::max(v->curTrackDistance(), m_bestDrivenDistance);
+    m_bestDrivenDistance = std::max(st.curDistance[i], m_bestDrivenDistance);
   }
 
   if (m_vehicleUser)
     m_vehicleUser->update(dt, this);
 
+  ++m_numSteps;
+
 
   // evolve population when all agents are dead
   if (!m_numVehiclesAlive && !m_vehicles.empty())
   {
     applyEvolution();
 
+    ++m_numGenerations;
+
+    // switch from bicycle pre-training to the selected dynamics, cached fitness of the other model is not comparable
+    BulletInterface::VehicleDynamics dynamics = m_numGenerations < m_desc.bicycleGenerations ? BulletInterface::BicycleVehicles : m_desc.vehicleDynamics;
+    if (dynamics != m_bullet->vehicleDynamics)
+    {
+      m_bullet->vehicleDynamics = dynamics;
+      m_fitnessCache.clear();
+    }
+
+    // the user car keeps driving, its times continue on the restarted clock
+    if (m_vehicleUser)
+      m_vehicleUser->shiftTime(-m_generationTime);
+
+    m_generationTime = 0.0;
+    m_raceNextRung = m_desc.racingHorizon;
+    m_raceRung = 0;
+
     resetVehicles();
   }
 }
 
+void Simulation::publishFrame(SimulationFrame* frame) const
+{
+  int numVehicles = static_cast<int>(m_vehicles.size()) + (m_vehicleUser ? 1 : 0);
+
+  btTransform chassisOffset;
+  chassisOffset.setIdentity();
+  chassisOffset.setOrigin(m_vehicleChassisOffset);
+
+  // suspension lengths of batched vehicles are only kept in their batch
+  m_bullet->storeWheels();
+
+  frame->boxes.clear();
+  for (int i = 0; i < numVehicles; ++i)
+  {
+    Vehicle* v = i < static_cast<int>(m_vehicles.size()) ? m_vehicles[i] : m_vehicleUser;
+    btRaycastVehicle* physics = v->physics();
+
+    const btTransform& chassis = physics->getChassisWorldTransform();
+
+    SimulationFrame::Box box;
+    box.transform = chassis * chassisOffset;
+    box.size = m_vehicleChassisExtents * 2.0f;
+    box.type = v->alive() ? SimulationFrame::Chassis : SimulationFrame::DeadChassis;
+    frame->boxes.push_back(box);
+
+    // wheels at suspension length, turned by steering but not rolling.
+    // the batched backends do not update btWheelInfo::m_worldTransform
+    for (int w = 0; w < physics->getNumWheels(); ++w)
+    {
+      const btWheelInfo& wheel = physics->getWheelInfo(w);
+
+      btTransform local;
+      local.setIdentity();
+      local.setOrigin(wheel.m_chassisConnectionPointCS + wheel.m_wheelDirectionCS * wheel.m_raycastInfo.m_suspensionLength);
+      local.setRotation(btQuaternion(-wheel.m_wheelDirectionCS, wheel.m_steering));
+
+      // wheel width is not kept by bullet, the vehicles are built with 0.8 * radius
+      btScalar r = wheel.m_wheelsRadius;
+
+      box.transform = chassis * local;
+      box.size = btVector3(0.8f * r, 2.0f * r, 2.0f * r);
+      box.type = SimulationFrame::Wheel;
+      frame->boxes.push_back(box);
+    }
+  }
+
+  // sensors of all vehicles are contiguous in the state store
+  const VehicleStateStore& st = m_vehicleStates;
+  int numSensors = st.size() * st.numSensors();
+
+  frame->sensorLines.resize(numSensors * 2);
+  frame->sensorsPerVehicle = st.numSensors();
+  for (int i = 0; i < numSensors; ++i)
+  {
+    const btVector3& start = st.sensorStart[i];
+    frame->sensorLines[i * 2] = start;
+    frame->sensorLines[i * 2 + 1] = start + (st.sensorEnd[i] - start).normalized() * st.sensorDist[i];
+  }
+
+  Vehicle* follow = m_vehicleUser ? m_vehicleUser : bestVehicle();
+  frame->hasFollowTarget = follow != 0;
+  if (follow)
+    frame->followTarget = follow->physics()->getRigidBody()->getWorldTransform();
+
+  frame->time = m_generationTime;
+  frame->numVehiclesAlive = m_numVehiclesAlive;
+  frame->bestDistance = m_bestDrivenDistance;
+  frame->avgDistance = m_avgDrivenDistance;
+  frame->generation = m_numGenerations;
+}
+
+void Simulation::raceVehicles()
+{
+  // vehicles ranked by driven distance, dead ones keep their final distance
+  size_t n = m_vehicles.size();
+
+  std::vector<Vehicle*> ranking(m_vehicles);
+  std::sort(ranking.begin(), ranking.end(), [](Vehicle* a, Vehicle* b) {return a->curTrackDistance() > b->curTrackDistance(); });
+
+  ++m_raceRung;
+
+  // rung r keeps the best n * keep^r vehicles
+  double keep = std::pow(static_cast<double>(m_desc.racingKeepFraction), m_raceRung);
+  size_t numKeep = std::max(static_cast<size_t>(std::ceil(n * keep)), static_cast<size_t>(1));
+
+  for (size_t i = numKeep; i < n; ++i)
+    ranking[i]->kill();
+
+  // survivors continue for a geometrically longer horizon
+  m_raceNextRung += m_desc.racingHorizon * std::pow(m_desc.racingHorizonGrowth, static_cast<float>(m_raceRung));
+}
+
+
+void Simulation::saveSnapshot()
+{
+  size_t n = m_vehicles.size();
+  m_snapshots.resize(n);
+
+  Vehicle* best = bestVehicle();
+  m_snapshotSource = -1;
+
+  for (size_t i = 0; i < n; ++i)
+  {
+    m_vehicles[i]->saveSnapshot(&m_snapshots[i], m_bullet, m_generationTime);
+
+    if (m_vehicles[i] == best)
+      m_snapshotSource = static_cast<int>(i);
+  }
+
+  m_snapshotGenerationTime = m_generationTime;
+  m_snapshotNumSteps = m_numSteps;
+  m_snapshotRaceNextRung = m_raceNextRung;
+  m_snapshotRaceRung = m_raceRung;
+}
+
+void Simulation::restoreSnapshot()
+{
+  if (m_snapshots.size() != m_vehicles.size())
+    return;
+
+  if (m_vehicleUser)
+    m_vehicleUser->shiftTime(m_snapshotGenerationTime - m_generationTime);
+
+  m_generationTime = m_snapshotGenerationTime;
+  m_numSteps = m_snapshotNumSteps;
+
+  for (size_t i = 0; i < m_vehicles.size(); ++i)
+    m_vehicles[i]->restoreSnapshot(m_snapshots[i], m_bullet, m_generationTime);
+
+  m_raceNextRung = m_snapshotRaceNextRung;
+  m_raceRung = m_snapshotRaceRung;
+}
 
 Vehicle* Simulation::bestVehicle() const
 {
@@ -250,7 +536,9 @@ void Simulation::initTrack()
     //  std::reverse(m_trackHeights.begin() + x, m_trackHeights.begin() + (h-1)*w + x);
 
 
-    std::shared_ptr<btHeightfieldTerrainShape> trackShape = std::make_shared<btHeightfieldTerrainShape>(w, h, &m_trackHeights[0], 10.0f / 256.0f, 0.0f, 10.0f, 1, PHY_UCHAR, false);
+    float heightScale = 10.0f / 256.0f, minHeight = 0.0f, maxHeight = 10.0f;
+
+    std::shared_ptr<btHeightfieldTerrainShape> trackShape = std::make_shared<btHeightfieldTerrainShape>(w, h, &m_trackHeights[0], heightScale, minHeight, maxHeight, 1, PHY_UCHAR, false);
 
     trackShape->setLocalScaling(btVector3(m_desc.trackScale, m_desc.trackScale, m_desc.trackScale));
 
@@ -265,6 +553,26 @@ void Simulation::initTrack()
     btVector3 shift(0.0f, diag[1] * 0.5f + m_desc.trackGroundLevel, 0.0f);
 
     m_trackBody = m_bullet->createManagedRigidBody(trackShape, 0.0f, shift, false);
+
+    // cpu copy for direct queries
+    m_trackHeightfield = new Heightfield(&m_trackHeights[0], w, h, heightScale, minHeight, maxHeight, trackShape->getLocalScaling(), shift);
+    m_bullet->setTerrain(m_trackBody, m_trackHeightfield);
+
+    // answer sensor rays from precomputed distance field or heightfield pyramid instead of bullet ray tests
+    std::string sensorEngine = m_settings->Get("vehicle", "sensorEngine", "bullet");
+    if (sensorEngine == "sdf")
+      m_trackDistanceField = new DistanceField(m_trackHeightfield);
+
+    m_heightfieldSensors = sensorEngine == "heightfield";
+    if (m_heightfieldSensors)
+      m_trackHeightfield->buildPyramid();
+
+    // chassis-track pairs are dropped from the broadphase and tested in killTrackCollisions
+    if (m_desc.analyticTrackCollision && !m_trackFilter)
+    {
+      m_trackFilter = new TrackOverlapFilter(m_trackBody);
+      m_bullet->world->getPairCache()->setOverlapFilterCallback(m_trackFilter);
+    }
   }
   else
     std::cout << "failed to load track heightmap" << std::endl;
@@ -310,7 +618,7 @@ void Simulation::initTrack()
 Vehicle* Simulation::createVehicle()
 {
   btRaycastVehicle* bvehicle = createVehiclePhysics();
-  Vehicle* vehicle = new Vehicle(bvehicle, m_settings);
+  Vehicle* vehicle = new Vehicle(bvehicle, m_settings, &m_vehicleStates);
 
   
   return vehicle;
@@ -339,6 +647,34 @@ btRaycastVehicle* Simulation::createVehiclePhysics()
     //it's center of gravity does not change. This way we can add the chassis rigidbody one unit above our center of gravity
     //keeping it under our chassis, and not in the middle of it
     m_vehicleChassisCompound->addChildShape(localTransform, m_vehicleChassisShape.get());
+
+    // sample chassis box for analytic track collision: grid on the bottom face and all edges,
+    // spacing of at most half a track cell
+    const btVector3& e = m_vehicleChassisExtents;
+    btScalar spacing = m_desc.trackScale * 0.5f;
+
+    int n[3];
+    for (int k = 0; k < 3; ++k)
+      n[k] = std::max(static_cast<int>(std::ceil(2.0f * e[k] / spacing)), 1);
+
+    m_vehicleChassisSamples.clear();
+    for (int z = 0; z <= n[2]; ++z)
+    {
+      for (int y = 0; y <= n[1]; ++y)
+      {
+        for (int x = 0; x <= n[0]; ++x)
+        {
+          // number of coordinates on the box boundary
+          int onBoundary = (x == 0 || x == n[0]) + (y == 0 || y == n[1]) + (z == 0 || z == n[2]);
+
+          if (onBoundary >= 2 || (y == 0 && onBoundary == 1))
+          {
+            btVector3 p(-e[0] + 2.0f * e[0] * x / n[0], -e[1] + 2.0f * e[1] * y / n[1], -e[2] + 2.0f * e[2] * z / n[2]);
+            m_vehicleChassisSamples.push_back(p + m_vehicleChassisOffset);
+          }
+        }
+      }
+    }
   }
 
   return m_bullet->createUnmanagedVehicle(m_vehicleChassisCompound, 1200, btVector3(0.0, 1.0, 0.0), Vehicle::collisionGroup(), ~Vehicle::collisionGroup());
@@ -350,46 +686,109 @@ void Simulation::applyEvolution()
   if (m_chromosomes.empty())
   {
     m_chromosomes.resize(n, 0);
-    m_chromosomesNext.resize(n, 0);
 
     for (size_t i = 0; i < n; ++i)
-    {
-      m_chromosomes[i] = new Vehicle::Chromosome(m_vehicles[i], &m_avgDrivenDistance);
-      m_chromosomesNext[i] = new Vehicle::Chromosome(m_vehicles[i], &m_avgDrivenDistance);
-    }
+      m_chromosomes[i] = new Vehicle::Chromosome(m_vehicles[i]);
   }
 
   m_avgDrivenDistance = 0.0f;
   for (size_t i = 0; i < n; ++i)
   {
-    Vehicle::Chromosome* c = dynamic_cast<Vehicle::Chromosome*>(m_chromosomes[i]);
+    Vehicle::Chromosome* c = m_chromosomes[i];
     c->readGenesFromVehicle();
 
     m_avgDrivenDistance += c->vehicle->curTrackDistance();
   }
   m_avgDrivenDistance /= static_cast<float>(n);
 
-  m_evolution->computeNewPopulation(m_chromosomes, m_chromosomesNext);
-  std::swap(m_chromosomes, m_chromosomesNext);
-  
+  // distances of branched rollouts depend on the saved state and are not cached,
+  // racing stops rollouts early so their distances are no natural fitness either
+  if (m_desc.fitnessCache && !m_desc.racing && !branching())
+  {
+    // bound memory of long runs
+    if (m_fitnessCache.size() > (1 << 16))
+      m_fitnessCache.clear();
+
+    for (size_t i = 0; i < n; ++i)
+    {
+      Vehicle::Chromosome* c = m_chromosomes[i];
+
+      CachedFitness& entry = m_fitnessCache[c->hash()];
+      entry.genes = c->genes;
+      entry.distance = c->vehicle->curTrackDistance();
+    }
+  }
+
+  std::vector<std::vector<float>*> genes(n);
+  std::vector<float> fitness(n);
+
+  for (size_t i = 0; i < n; ++i)
+  {
+    Vehicle::Chromosome* c = m_chromosomes[i];
+    genes[i] = &c->genes;
+    fitness[i] = c->vehicle->curTrackDistance();
+  }
+
+  m_optimizer->computeNewPopulation(genes, fitness);
+
   for (size_t i = 0; i < n; ++i)
   {
-    Vehicle::Chromosome* c = dynamic_cast<Vehicle::Chromosome*>(m_chromosomes[i]);
+    Vehicle::Chromosome* c = m_chromosomes[i];
     c->transferGenesToVehicle();
   }
 }
 
+void Simulation::updateControlPhases()
+{
+  // the phase follows the genome, so a genome drives the same trajectory in whatever slot it lands
+  size_t n = m_vehicles.size();
+  m_controlPhases.assign(n, 0);
+
+  if (m_desc.controlInterval <= 1)
+    return;
+
+  for (size_t i = 0; i < n; ++i)
+  {
+    Vehicle::Chromosome c(m_vehicles[i]);
+    m_controlPhases[i] = static_cast<int>(c.hash() % static_cast<size_t>(m_desc.controlInterval));
+  }
+}
+
 void Simulation::resetVehicles()
 {
   size_t n = m_vehicles.size();
+
+  m_numSteps = 0;
+  updateControlPhases();
+
   for (size_t i = 0; i < n; ++i)
   {
     Vehicle* v = m_vehicles[i];
     
-    v->reset();
+    v->reset(m_generationTime);
 
     // replace with new bullet raycast vehicle
     btRaycastVehicle* vphysics = createVehiclePhysics();
-    v->replacePhysics(vphysics, m_bullet->world);
+    v->replacePhysics(vphysics, m_bullet);
+  }
+
+  // all genomes continue from the same saved state
+  if (branching())
+  {
+    for (size_t i = 0; i < n; ++i)
+      m_vehicles[i]->restoreSnapshot(m_snapshots[m_snapshotSource], m_bullet, m_generationTime);
+  }
+
+  // genomes evaluated before don't need to be simulated again
+  if (m_desc.fitnessCache && !m_desc.racing && !branching() && m_chromosomes.size() == n)
+  {
+    for (size_t i = 0; i < n; ++i)
+    {
+      Vehicle::Chromosome* c = m_chromosomes[i];
+
+      std::unordered_map<size_t, CachedFitness>::const_iterator it = m_fitnessCache.find(c->hash());
+      if (it != m_fitnessCache.end() && it->second.genes == c->genes)
+        c->vehicle->kill(it->second.distance);
+    }
   }
 }
@@ -1,10 +1,15 @@
 #pragma once
 
 #include "../BulletInterface.h"
+#include "../DistanceField.h"
 
 #include "Vehicle.h"
+#include "Optimizer.h"
+#include "SimulationFrame.h"
 
+#include <atomic>
 #include <string>
+#include <unordered_map>
 
 #include <AntTweakBar.h>
 
@@ -25,6 +30,9 @@ public:
 
   void update(double dt);
 
+  // copy renderer state of the current step into frame, reuses its memory
+  void publishFrame(SimulationFrame* frame) const;
+
   btDynamicsWorld* world() { return m_bullet->world; }
 
   int numVehicles() const { return static_cast<int>(m_vehicles.size()) + (m_vehicleUser ? 1 : 0); }
@@ -38,8 +46,42 @@ public:
 
   btRigidBody* trackBody() { return m_trackBody; }
 
+  // chassis box shared by all vehicles: half extents and center in chassis body space
+  const btVector3& vehicleChassisExtents() const { return m_vehicleChassisExtents; }
+  const btVector3& vehicleChassisOffset() const { return m_vehicleChassisOffset; }
+
+  // cpu copy of the track surface, 0 if the track could not be loaded
+  const Heightfield* trackHeightfield() const { return m_trackHeightfield; }
+
+  // distance field for vehicle sensors, 0 if disabled or other bodies than the track are in the world
+  const DistanceField* sensorField() const { return m_bullet->terrainOnly() ? m_trackDistanceField : 0; }
+
+  // heightfield for vehicle sensors, same conditions as sensorField.
+  // bicycle vehicles are not in the world and always use it unless the distance field is enabled
+  const Heightfield* sensorHeightfield() const
+  {
+    bool bicycle = m_bullet->vehicleDynamics == BulletInterface::BicycleVehicles;
+    return m_bullet->terrainOnly() && (m_heightfieldSensors || bicycle) ? m_trackHeightfield : 0;
+  }
+
   Vehicle* userVehicle() { return m_vehicleUser; }
 
+  // simulated seconds since the start of the current generation
+  double generationTime() const { return m_generationTime; }
+
+  // state of vehicle(i) is in slot i
+  const VehicleStateStore& vehicleStates() const { return m_vehicleStates; }
+
+
+  // save state of all ai vehicles and the generation clock, the best vehicle becomes the branch source
+  void saveSnapshot();
+  // every vehicle returns to its own saved state
+  void restoreSnapshot();
+  bool hasSnapshot() const { return !m_snapshots.empty(); }
+
+  // start every generation from the saved state of the best vehicle instead of the track start
+  bool branching() const { return m_branchRollouts && m_snapshotSource >= 0; }
+
 private:
 
   void initTrack();
@@ -50,16 +92,29 @@ private:
   void applyEvolution();
 
   void resetVehicles();
+  void updateControlPhases();
+
+  // successive halving: kill all but the best fraction at the end of a racing rung
+  void raceVehicles();
 
   // iterate over all contact pairs in bullet collision lib
   static void subtickCallback(btDynamicsWorld* world, btScalar timeStep);
 
+  // kill vehicles whose chassis samples are below the track surface
+  void killTrackCollisions();
+
+  static void TW_CALL saveSnapshotCallback(void* clientData);
+  static void TW_CALL restoreSnapshotCallback(void* clientData);
+
 
 private:
 
   struct Desc
   {
-    Desc() : numCars(20), trackScale(1.0f), trackGroundLevel(1.0f), restartLap(1) {}
+    Desc() : numCars(20), trackScale(1.0f), trackGroundLevel(1.0f), restartLap(1),
+      racing(false), racingHorizon(5.0f), racingHorizonGrowth(2.0f), racingKeepFraction(0.5f),
+      fitnessCache(false), controlInterval(1), analyticTrackCollision(false),
+      vehicleDynamics(BulletInterface::RaycastVehicles), bicycleGenerations(0) {}
 
     int numCars;
 
@@ -69,6 +124,27 @@ private:
     float trackGroundLevel;
 
     int restartLap;
+
+    // rollout racing: first rung length in simulated seconds,
+    // growth factor of following rungs and fraction of vehicles surviving each rung
+    bool racing;
+    float racingHorizon;
+    float racingHorizonGrowth;
+    float racingKeepFraction;
+
+    // skip evaluation of genomes with known fitness (deterministic simulation only, disabled by racing)
+    bool fitnessCache;
+
+    // number of physics steps between sensor/controller updates of a vehicle,
+    // vehicles are staggered by a phase taken from their genes so that results stay deterministic
+    int controlInterval;
+
+    // detect chassis-track contact on the heightfield instead of bullet narrowphase
+    bool analyticTrackCollision;
+
+    // vehicle backend, the first bicycleGenerations generations are pre-trained on the bicycle model
+    BulletInterface::VehicleDynamics vehicleDynamics;
+    int bicycleGenerations;
   };
 
   Desc m_desc;
@@ -90,19 +166,64 @@ private:
   btVector3 m_vehicleChassisOffset;
   btVector3 m_vehicleChassisExtents;
 
+  // points on chassis box edges and bottom face in chassis body space
+  std::vector<btVector3> m_vehicleChassisSamples;
+
   Vehicle* m_vehicleUser;
   std::vector<Vehicle*> m_vehicles;
+  VehicleStateStore m_vehicleStates;
 
-  std::vector<EvolutionProcess::Chromosome*> m_chromosomes;
-  std::vector<EvolutionProcess::Chromosome*> m_chromosomesNext;
+  std::vector<Vehicle::Chromosome*> m_chromosomes;
   float m_avgDrivenDistance;
   float m_bestDrivenDistance;
   int m_numVehiclesAlive;
 
-  EvolutionProcess* m_evolution;
+  // simulated time of current generation and racing state
+  double m_generationTime;
+  double m_raceNextRung;
+  int m_raceRung;
+
+  // physics steps since start of the generation, staggers vehicle control updates
+  unsigned int m_numSteps;
+  // control update phase of vehicle(i), derived from its genes
+  std::vector<int> m_controlPhases;
+
+  int m_numGenerations;
+
+  // driven distance of evaluated genomes, key is Vehicle::Chromosome::hash()
+  // genes are stored with the distance to reject hash collisions
+  struct CachedFitness
+  {
+    std::vector<float> genes;
+    float distance;
+  };
+  std::unordered_map<size_t, CachedFitness> m_fitnessCache;
+
+  // tweak bar buttons run on the window thread, requests are served at the start of update
+  std::atomic<bool> m_saveSnapshotRequest;
+  std::atomic<bool> m_restoreSnapshotRequest;
+
+  // tweak bar variables of simulation state
+  TweakVars m_tweakVars;
+
+  // saved vehicle states for restore and branched rollouts, index of vehicle(i) is i
+  std::vector<Vehicle::Snapshot> m_snapshots;
+  int m_snapshotSource;
+  double m_snapshotGenerationTime;
+  unsigned int m_snapshotNumSteps;
+  double m_snapshotRaceNextRung;
+  int m_snapshotRaceRung;
+  bool m_branchRollouts;
+
+  // gene vector optimizer, selected by [evolution] optimizer: ga, es or cmaes
+  Optimizer* m_optimizer;
 
   std::vector<unsigned char> m_trackHeights;
+  Heightfield* m_trackHeightfield;
+  DistanceField* m_trackDistanceField;
+  bool m_heightfieldSensors;
   btRigidBody* m_trackBody;
+  btOverlapFilterCallback* m_trackFilter;
   std::vector<btVector3> m_trackSegments;
   std::vector<float> m_trackSegmentDist; // accumulated distance from start to segment
 };
\ No newline at end of file
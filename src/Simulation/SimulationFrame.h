@@ -0,0 +1,62 @@
+#pragma once
+
+#include <btBulletDynamicsCommon.h>
+
+#include <vector>
+
+
+// Copy of everything the renderer needs from one simulation step, see Simulation::publishFrame.
+// Once published the frame is not touched by the simulation, so it can be drawn from another thread.
+struct SimulationFrame
+{
+  SimulationFrame() : time(0.0), sensorsPerVehicle(0), hasFollowTarget(false), hasPrevious(false), numVehiclesAlive(0), bestDistance(0.0f), avgDistance(0.0f), generation(0) {}
+
+  // simulated time in current generation
+  double time;
+
+  enum BoxType
+  {
+    Chassis,
+    DeadChassis,
+    Wheel
+  };
+
+  // chassis and wheels of all vehicles as scaled unit cubes
+  struct Box
+  {
+    btTransform transform;
+    btVector3 size;
+    int type;
+  };
+  std::vector<Box> boxes;
+
+  // start and end point of each sensor ray, clipped to the measured distance.
+  // the sensorsPerVehicle rays of a vehicle are contiguous
+  std::vector<btVector3> sensorLines;
+  int sensorsPerVehicle;
+
+  // chassis of the user or best vehicle for the follow camera
+  btTransform followTarget;
+  bool hasFollowTarget;
+
+  // box transforms and follow target of the step before, boxes[i] was at prevTransforms[i].
+  // not set by publishFrame, valid if hasPrevious
+  std::vector<btTransform> prevTransforms;
+  btTransform prevFollowTarget;
+  bool hasPrevious;
+
+  // state at fraction t between the previous and this step
+  btTransform boxTransform(int i, btScalar t) const { return hasPrevious ? lerp(prevTransforms[i], boxes[i].transform, t) : boxes[i].transform; }
+  btTransform followTransform(btScalar t) const { return hasPrevious ? lerp(prevFollowTarget, followTarget, t) : followTarget; }
+
+  static btTransform lerp(const btTransform& a, const btTransform& b, btScalar t)
+  {
+    return btTransform(a.getRotation().slerp(b.getRotation(), t), a.getOrigin().lerp(b.getOrigin(), t));
+  }
+
+  // statistics of the current generation
+  int numVehiclesAlive;
+  float bestDistance;
+  float avgDistance;
+  int generation;
+};
@@ -13,25 +13,35 @@
 
 
 
-float Vehicle::Chromosome::mutationMaxChange = 0.6f;
 
 std::string Vehicle::m_sensorConfigFile = "";
 std::vector<btVector3> Vehicle::m_sensorConfig;
 
 
-Vehicle::Vehicle(btRaycastVehicle* bvehicle, INIReader* settings)
-  : m_vehicle(bvehicle), m_controller(0), m_neuralNetwork(0),
+Vehicle::Vehicle(btRaycastVehicle* bvehicle, INIReader* settings, VehicleStateStore* states)
+  : m_vehicle(bvehicle), m_controller(0), m_states(states), m_slot(-1), m_sensorReach(0.0f), m_neuralNetwork(0),
   m_steerMax(0.6f),
   m_engineForceFwdMax(5000.0f), m_engineForceRevMax(-3000.0f),
-  m_brakeMax(500.0f),
-  m_bestSegment(0), m_curSegment(0), m_travelDir(0), m_bestDistance(0.0f), m_curDistance(0.0f), m_curLap(0),
-  m_alive(true)
+  m_brakeMax(500.0f)
 {
-  m_birthTime = glfwGetTime();
-  m_curSegmentEntryTime = m_birthTime;
-
   initSensors(settings);
 
+  m_slot = m_states->add(numSensors());
+
+  // times are simulated seconds since the start of the generation
+  m_states->birthTime[m_slot] = 0.0;
+  m_states->curSegmentEntryTime[m_slot] = 0.0;
+
+  // initial sensor rays
+  const btTransform& t = m_vehicle->getChassisWorldTransform();
+  for (int i = 0; i < numSensors(); ++i)
+  {
+    int k = m_states->sensorIndex(m_slot, i);
+    m_states->sensorStart[k] = t * m_sensors[i].startOS;
+    m_states->sensorEnd[k] = t * m_sensors[i].endOS;
+    m_states->sensorDist[k] = m_sensors[i].maxDist;
+  }
+
 
   m_steerMax = static_cast<float>(settings->GetReal("vehicle", "steerMax", m_steerMax));
   m_engineForceFwdMax = static_cast<float>(settings->GetReal("vehicle", "engineForceFwdMax", m_engineForceFwdMax));
@@ -69,17 +79,63 @@ void Vehicle::setControllerNeuralNet(bool enableBrake)
   m_controller = new VehicleControllerNeuralNet(this, enableBrake);
 }
 
-void Vehicle::update(double dt, Simulation* sim)
+void Vehicle::update(double dt, Simulation* sim, bool control)
 {
+  const DistanceField* field = sim->sensorField();
+  const Heightfield* terrain = sim->sensorHeightfield();
+
+  const btTransform& chassis = m_vehicle->getChassisWorldTransform();
+
+  m_states->position[m_slot] = chassis.getOrigin();
+  m_states->velocity[m_slot] = m_vehicle->getRigidBody()->getLinearVelocity();
+
+  // early out: no obstacle within reach of any sensor
+  bool sensorsClear = false;
+  if (field && control)
+  {
+    const btVector3& pos = m_states->position[m_slot];
+    sensorsClear = field->distance(pos[0], pos[2]) > m_sensorReach;
+  }
+
   // update sensors
-  for (int i = 0; i < numSensors(); ++i)
+  for (int i = 0; control && i < numSensors(); ++i)
   {
     Sensor* s = sensor(i);
 
-    s->startWS = m_vehicle->getChassisWorldTransform() * s->startOS;
-    s->endWS = m_vehicle->getChassisWorldTransform() * s->endOS;
+    int k = m_states->sensorIndex(m_slot, i);
+    btVector3& startWS = m_states->sensorStart[k];
+    btVector3& endWS = m_states->sensorEnd[k];
+    btScalar& dist = m_states->sensorDist[k];
+
+    startWS = chassis * s->startOS;
+    endWS = chassis * s->endOS;
+
+    if (field)
+    {
+      btScalar fraction;
+
+      // a clear sensor may still hit the road if the chassis is tilted
+      bool clear = sensorsClear && std::min(startWS[1], endWS[1]) > field->freeHeight();
 
-    btCollisionWorld::ClosestRayResultCallback hit(s->startWS, s->endWS);
+      dist = s->maxDist;
+      if (!clear && field->rayTest(startWS, endWS, &fraction))
+        dist *= fraction;
+
+      continue;
+    }
+
+    if (terrain)
+    {
+      btScalar fraction;
+
+      dist = s->maxDist;
+      if (terrain->rayTestHierarchical(startWS, endWS, &fraction))
+        dist *= fraction;
+
+      continue;
+    }
+
+    btCollisionWorld::ClosestRayResultCallback hit(startWS, endWS);
 
     // ignore other vehicles in the simulation
     hit.m_collisionFilterGroup = collisionGroup();
@@ -87,26 +143,26 @@ void Vehicle::update(double dt, Simulation* sim)
 
     sim->world()->rayTest(hit.m_rayFromWorld, hit.m_rayToWorld, hit);
     
-    s->dist = s->maxDist;
+    dist = s->maxDist;
     if (hit.hasHit())
-      s->dist *= hit.m_closestHitFraction;
+      dist *= hit.m_closestHitFraction;
   }
 
   // update performance
   updateTrackPerformance(sim);
 
 
-  if (m_controller)
+  if (m_controller && control)
     m_controller->update(dt);
 }
 
 
-void Vehicle::replacePhysics(btRaycastVehicle* vehicle, btDynamicsWorld* world)
+void Vehicle::replacePhysics(btRaycastVehicle* vehicle, BulletInterface* bullet)
 {
   if (m_vehicle)
   {
-    world->removeRigidBody(m_vehicle->getRigidBody());
-    world->removeVehicle(m_vehicle);
+    bullet->world->removeRigidBody(m_vehicle->getRigidBody());
+    bullet->removeVehicle(m_vehicle);
 
     delete m_vehicle->getRigidBody()->getMotionState();
     delete m_vehicle->getRigidBody();
@@ -124,10 +180,8 @@ void Vehicle::addSensor(const btVector3& start, const btVector3& end)
   s.endOS = end;
 
   s.maxDist = (start - end).norm();
-  s.dist = s.maxDist;
 
-  s.startWS = m_vehicle->getChassisWorldTransform() * s.startOS;
-  s.endWS = m_vehicle->getChassisWorldTransform() * s.endOS;
+  m_sensorReach = std::max(m_sensorReach, std::max(start.norm(), end.norm()));
 
   m_sensors.push_back(s);
 }
@@ -167,7 +221,10 @@ void Vehicle::updateTrackPerformance(Simulation* sim)
   btVector3 nearestSegProj;
   float trackDist = -1.0f;
 
-  btVector3 vpos = m_vehicle->getChassisWorldTransform().getOrigin();
+  VehicleStateStore& st = *m_states;
+  int slot = m_slot;
+
+  btVector3 vpos = st.position[slot];
 
   int nsegs = static_cast<int>(sim->trackSegments().size());
   for (int i = 0; i < nsegs; ++i)
@@ -200,33 +257,33 @@ void Vehicle::updateTrackPerformance(Simulation* sim)
   if (nearestSeg >= 0)
   {
     // update travel direction
-    const btVector3& vel = m_vehicle->getRigidBody()->getLinearVelocity();
+    const btVector3& vel = st.velocity[slot];
     btVector3 n = segments[(nearestSeg + 1) % nsegs] - segments[nearestSeg];
 
     btScalar vdotn = vel.dot(n);
 
     if (vel.dot(vel) < 1e-6f)
-      m_travelDir = 0;
+      st.travelDir[slot] = 0;
     else if (vdotn > 0)
-      m_travelDir = 1;
+      st.travelDir[slot] = 1;
     else if (vdotn < 0)
-      m_travelDir = -1;
+      st.travelDir[slot] = -1;
 
     // update segment info
-    if (m_travelDir > 0 && (nearestSeg < m_bestSegment + 5))
+    if (st.travelDir[slot] > 0 && (nearestSeg < st.bestSegment[slot] + 5))
     {
-      if (!nearestSeg && m_curSegment == nsegs - 1)
-        ++m_curLap;
+      if (!nearestSeg && st.curSegment[slot] == nsegs - 1)
+        ++st.curLap[slot];
 
-      m_bestSegment = std::max(m_bestSegment, nearestSeg);
-      m_bestDistance = std::max(m_bestDistance, trackDist);
+      st.bestSegment[slot] = std::max(st.bestSegment[slot], nearestSeg);
+      st.bestDistance[slot] = std::max(st.bestDistance[slot], trackDist);
 
-      m_curDistance = trackDist + static_cast<float>(m_curLap) * distances.back();
+      st.curDistance[slot] = trackDist + static_cast<float>(st.curLap[slot]) * distances.back();
 
-      if (m_curSegment != nearestSeg)
-        m_curSegmentEntryTime = glfwGetTime();
+      if (st.curSegment[slot] != nearestSeg)
+        st.curSegmentEntryTime[slot] = sim->generationTime();
     
-      m_curSegment = nearestSeg;
+      st.curSegment[slot] = nearestSeg;
     }
   }
 }
@@ -287,18 +344,19 @@ void Vehicle::initSensors(INIReader* settings)
 }
 
 
-void Vehicle::reset()
+void Vehicle::reset(double time)
 {
   // reanimate vehicle and restore initial state of simulation
-  m_bestDistance = 0.0f;
-  m_curDistance = 0.0f;
-  m_bestSegment = 0;
-  m_curSegment = 0;
-  m_curLap = 0;
+  VehicleStateStore& st = *m_states;
+  st.bestDistance[m_slot] = 0.0f;
+  st.curDistance[m_slot] = 0.0f;
+  st.bestSegment[m_slot] = 0;
+  st.curSegment[m_slot] = 0;
+  st.curLap[m_slot] = 0;
 
-  m_alive = true;
-  m_birthTime = glfwGetTime();
-  m_curSegmentEntryTime = m_birthTime;
+  st.alive[m_slot] = 1;
+  st.birthTime[m_slot] = time;
+  st.curSegmentEntryTime[m_slot] = time;
 
   btRigidBody* body = m_vehicle->getRigidBody();
 
@@ -320,8 +378,60 @@ void Vehicle::reset()
     m_vehicle->applyEngineForce(0, i);
     m_vehicle->setBrake(0, i);
   }
+}
+
+void Vehicle::shiftTime(double offset)
+{
+  m_states->birthTime[m_slot] += offset;
+  m_states->curSegmentEntryTime[m_slot] += offset;
+}
 
-  m_birthTime = glfwGetTime();
+void Vehicle::saveSnapshot(Snapshot* snapshot, BulletInterface* bullet, double time) const
+{
+  bullet->saveVehicleState(m_vehicle, &snapshot->physics);
+
+  const VehicleStateStore& st = *m_states;
+  snapshot->bestSegment = st.bestSegment[m_slot];
+  snapshot->curSegment = st.curSegment[m_slot];
+  snapshot->travelDir = st.travelDir[m_slot];
+  snapshot->curLap = st.curLap[m_slot];
+  snapshot->bestDistance = st.bestDistance[m_slot];
+  snapshot->curDistance = st.curDistance[m_slot];
+  snapshot->alive = st.alive[m_slot];
+
+  snapshot->age = time - st.birthTime[m_slot];
+  snapshot->segmentAge = time - st.curSegmentEntryTime[m_slot];
+
+  int k = st.sensorIndex(m_slot, 0);
+  snapshot->sensorStart.assign(st.sensorStart.begin() + k, st.sensorStart.begin() + k + numSensors());
+  snapshot->sensorEnd.assign(st.sensorEnd.begin() + k, st.sensorEnd.begin() + k + numSensors());
+  snapshot->sensorDist.assign(st.sensorDist.begin() + k, st.sensorDist.begin() + k + numSensors());
+}
+
+void Vehicle::restoreSnapshot(const Snapshot& snapshot, BulletInterface* bullet, double time)
+{
+  bullet->restoreVehicleState(m_vehicle, snapshot.physics);
+
+  VehicleStateStore& st = *m_states;
+  st.position[m_slot] = snapshot.physics.transform.getOrigin();
+  st.velocity[m_slot] = snapshot.physics.linearVelocity;
+
+  st.bestSegment[m_slot] = snapshot.bestSegment;
+  st.curSegment[m_slot] = snapshot.curSegment;
+  st.travelDir[m_slot] = snapshot.travelDir;
+  st.curLap[m_slot] = snapshot.curLap;
+  st.bestDistance[m_slot] = snapshot.bestDistance;
+  st.curDistance[m_slot] = snapshot.curDistance;
+  st.alive[m_slot] = snapshot.alive;
+
+  st.birthTime[m_slot] = time - snapshot.age;
+  st.curSegmentEntryTime[m_slot] = time - snapshot.segmentAge;
+
+  int k = st.sensorIndex(m_slot, 0);
+  int n = std::min(numSensors(), static_cast<int>(snapshot.sensorDist.size()));
+  std::copy(snapshot.sensorStart.begin(), snapshot.sensorStart.begin() + n, st.sensorStart.begin() + k);
+  std::copy(snapshot.sensorEnd.begin(), snapshot.sensorEnd.begin() + n, st.sensorEnd.begin() + k);
+  std::copy(snapshot.sensorDist.begin(), snapshot.sensorDist.begin() + n, st.sensorDist.begin() + k);
 }
 
 VehicleController::VehicleController(Vehicle* vehicle)
@@ -331,11 +441,27 @@ VehicleController::VehicleController(Vehicle* vehicle)
 }
 
 VehicleControllerUser::VehicleControllerUser(Vehicle* vehicle, Application* app)
-  : VehicleController(vehicle)
+  : VehicleController(vehicle), m_steering(0.0f), m_engineForce(0.0f), m_brake(0.0f)
 {
   app->addUserInputController(this);
 }
 
+void VehicleControllerUser::update(double dt)
+{
+  float steering = m_steering;
+  float engineForce = m_engineForce;
+  float brake = m_brake;
+
+  m_vehicle->physics()->setSteeringValue(steering, 0);
+  m_vehicle->physics()->setSteeringValue(steering, 1);
+
+  m_vehicle->physics()->applyEngineForce(engineForce, 2);
+  m_vehicle->physics()->applyEngineForce(engineForce, 3);
+
+  m_vehicle->physics()->setBrake(brake, 2);
+  m_vehicle->physics()->setBrake(brake, 3);
+}
+
 void VehicleControllerUser::keyEvent(GLFWwindow* wnd, int key, int scancode, int action, int mods)
 {
   if (m_vehicle)
@@ -343,60 +469,37 @@ void VehicleControllerUser::keyEvent(GLFWwindow* wnd, int key, int scancode, int
     if (action != GLFW_RELEASE)
     {
       if (key == GLFW_KEY_LEFT)
-      {
-        m_vehicle->physics()->setSteeringValue(m_vehicle->steerMax(), 0);
-        m_vehicle->physics()->setSteeringValue(m_vehicle->steerMax(), 1);
-      }
+        m_steering = m_vehicle->steerMax();
 
       if (key == GLFW_KEY_RIGHT)
-      {
-        m_vehicle->physics()->setSteeringValue(-m_vehicle->steerMax(), 0);
-        m_vehicle->physics()->setSteeringValue(-m_vehicle->steerMax(), 1);
-      }
+        m_steering = -m_vehicle->steerMax();
 
       if (key == GLFW_KEY_UP)
-      {
-        m_vehicle->physics()->applyEngineForce(m_vehicle->engineForceFwdMax(), 2);
-        m_vehicle->physics()->applyEngineForce(m_vehicle->engineForceFwdMax(), 3);
-      }
+        m_engineForce = m_vehicle->engineForceFwdMax();
 
       if (key == GLFW_KEY_DOWN)
-      {
-        m_vehicle->physics()->applyEngineForce(m_vehicle->engineForceRevMax(), 2);
-        m_vehicle->physics()->applyEngineForce(m_vehicle->engineForceRevMax(), 3);
-      }
+        m_engineForce = m_vehicle->engineForceRevMax();
 
       //Handbrake
       if (key == GLFW_KEY_SPACE)
-      {
-        m_vehicle->physics()->setBrake(m_vehicle->brakeMax(), 2);
-        m_vehicle->physics()->setBrake(m_vehicle->brakeMax(), 3);
-      }
+        m_brake = m_vehicle->brakeMax();
     }
     else
     {
       if (key == GLFW_KEY_LEFT || key == GLFW_KEY_RIGHT)
-      {
-        m_vehicle->physics()->setSteeringValue(0, 0);
-        m_vehicle->physics()->setSteeringValue(0, 1);
-      }
+        m_steering = 0.0f;
 
       if (key == GLFW_KEY_UP || key == GLFW_KEY_DOWN)
       {
-        m_vehicle->physics()->applyEngineForce(0, 2);
-        m_vehicle->physics()->applyEngineForce(0, 3);
+        m_engineForce = 0.0f;
 
         //Default braking force, always added otherwise there is no friction on the wheels
-        m_vehicle->physics()->setBrake(10, 2);
-        m_vehicle->physics()->setBrake(10, 3);
+        m_brake = 10.0f;
       }
 
       //Handbrake
       if (key == GLFW_KEY_SPACE)
-      {
-        m_vehicle->physics()->setBrake(0, 2);
-        m_vehicle->physics()->setBrake(0, 3);
-      }
+        m_brake = 0.0f;
     }
   }
 }
@@ -429,15 +532,17 @@ VehicleControllerNeuralNet::VehicleControllerNeuralNet(Vehicle* vehicle, bool en
 
 void VehicleControllerNeuralNet::update(double dt)
 {
-  // get sensor data
-  int ns = m_vehicle->numSensors();
+  // get sensor data and speed from contiguous state
+  const VehicleStateStore* st = m_vehicle->states();
+  int slot = m_vehicle->stateSlot();
+
+  int ns = st->numSensors();
   std::vector<float> input(ns + 1);
 
   for (int i = 0; i < ns; ++i)
-    input[i] = m_vehicle->sensor(i)->dist;
+    input[i] = st->sensorDist[st->sensorIndex(slot, i)];
 
-  // get speed
-  input[ns] = m_vehicle->physics()->getRigidBody()->getLinearVelocity().norm();
+  input[ns] = st->velocity[slot].norm();
 
 
   // get output from neural network
@@ -479,47 +584,21 @@ int VehicleControllerNeuralNet::dof()
 }
 
 
-void Vehicle::Chromosome::crossover(const EvolutionProcess::Chromosome* _other, float prob, EvolutionProcess::Chromosome* _resultA, EvolutionProcess::Chromosome* _resultB) const
+size_t Vehicle::Chromosome::hash() const
 {
-  const Chromosome* other = dynamic_cast<const Chromosome*>(_other);
-  Chromosome* resultA = dynamic_cast<Chromosome*>(_resultA);
-  Chromosome* resultB = dynamic_cast<Chromosome*>(_resultB);
+  // FNV-1a over the raw gene bytes
+  unsigned long long h = 14695981039346656037ull;
 
-  size_t n = genes.size();
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(genes.data());
+  size_t n = genes.size() * sizeof(float);
 
   for (size_t i = 0; i < n; ++i)
   {
-    const Chromosome* a = this;
-    const Chromosome* b = other;
-
-    float u = static_cast<float>(std::rand()) / RAND_MAX;
-    if (u < prob)
-      std::swap(a, b);
-    
-    resultA->genes[i] = a->genes[i];
-    if (resultB)
-      resultB->genes[i] = b->genes[i];
+    h ^= p[i];
+    h *= 1099511628211ull;
   }
-}
-
-void Vehicle::Chromosome::mutate(float prob)
-{
-  size_t n = genes.size();
 
-  for (size_t i = 0; i < n; ++i)
-  {
-    float u = static_cast<float>(std::rand()) / RAND_MAX;
-    if (u < prob)
-    {
-      float m = static_cast<float>(std::rand()) / RAND_MAX * 2.0f - 1.0f;
-      genes[i] += m * mutationMaxChange;
-    }
-  }
-}
-
-float Vehicle::Chromosome::fitness() const
-{
-  return vehicle->curTrackDistance() / *avgDrivenDistance;
+  return static_cast<size_t>(h);
 }
 
 void Vehicle::Chromosome::readGenesFromVehicle()
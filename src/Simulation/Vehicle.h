@@ -3,12 +3,14 @@
 #include "../UserInputController.h"
 
 #include "NeuralNetwork.h"
-#include "Evolution.h"
+#include "VehicleStateStore.h"
 
 #include "../BulletInterface.h"
 
 #include <IniReader.h>
 
+#include <atomic>
+
 
 class VehicleController;
 class Application;
@@ -18,7 +20,8 @@ class Vehicle
 {
 public:
 
-  Vehicle(btRaycastVehicle* bvehicle, INIReader* settings);
+  // hot per-step state lives in a slot of states
+  Vehicle(btRaycastVehicle* bvehicle, INIReader* settings, VehicleStateStore* states);
   virtual ~Vehicle();
 
 
@@ -26,38 +29,33 @@ public:
   void setControllerUser(Application* app);
   void setControllerNeuralNet(bool enableBrake);
 
-  void update(double dt, Simulation* sim);
+  // control: update sensors and controller in this step,
+  // otherwise the last actions are held and only track progress is updated
+  void update(double dt, Simulation* sim, bool control = true);
 
 
-  void replacePhysics(btRaycastVehicle* vehicle, btDynamicsWorld* world);
+  void replacePhysics(btRaycastVehicle* vehicle, BulletInterface* bullet);
   btRaycastVehicle* physics() { return m_vehicle; }
   VehicleController* controller() { return m_controller; }
 
   NeuralNetwork* neuralNetwork() { return m_neuralNetwork; }
 
 
+  // world space rays and measured distances are in the state store
   struct Sensor
   {
     // object space
     btVector3 startOS;
     btVector3 endOS;
 
-
-    // world space
-    btVector3 startWS;
-    btVector3 endWS;
-
-
     btScalar maxDist;
-
-    btScalar dist;
   };
 
-  void addSensor(const btVector3& start, const btVector3& end);
-
   int numSensors() const { return static_cast<int>(m_sensors.size()); }
   Sensor* sensor(int i) { return &m_sensors[i]; }
 
+  btScalar sensorDist(int i) const { return m_states->sensorDist[m_states->sensorIndex(m_slot, i)]; }
+
 
   // Init sensors before neural network!
   // Pass number of neurons for each internal layer.
@@ -68,32 +66,68 @@ public:
   static int collisionGroup() { return (1<<3); }
 
 
-  const int& bestTrackSegment() const { return m_bestSegment; }
-  const int& curTrackSegment() const { return m_curSegment; }
-  const double& curTrackSegmentEntryTime() const { return m_curSegmentEntryTime; }
-  const int& curLap() const { return m_curLap; }
+  VehicleStateStore* states() { return m_states; }
+  int stateSlot() const { return m_slot; }
+
+  const int& bestTrackSegment() const { return m_states->bestSegment[m_slot]; }
+  const int& curTrackSegment() const { return m_states->curSegment[m_slot]; }
+  const double& curTrackSegmentEntryTime() const { return m_states->curSegmentEntryTime[m_slot]; }
+  const int& curLap() const { return m_states->curLap[m_slot]; }
 
-  const float& bestTrackDistance() const { return m_bestDistance; }
-  const float& curTrackDistance() const { return m_curDistance; }
+  const float& bestTrackDistance() const { return m_states->bestDistance[m_slot]; }
+  const float& curTrackDistance() const { return m_states->curDistance[m_slot]; }
 
-  const int& travelDir() const { return m_travelDir; }
+  const int& travelDir() const { return m_states->travelDir[m_slot]; }
 
 
-  const bool& alive() const { return m_alive; }
-  void kill() { m_alive = false; }
-  double birthTime() const { return m_birthTime; }
-  void reset();
+  bool alive() const { return m_states->alive[m_slot] != 0; }
+  void kill() { m_states->alive[m_slot] = 0; }
+  // finish without simulating, track distance known from previous evaluation
+  void kill(float trackDistance) { m_states->curDistance[m_slot] = m_states->bestDistance[m_slot] = trackDistance; kill(); }
+  // simulated time of the generation when the vehicle was (re)started
+  double birthTime() const { return m_states->birthTime[m_slot]; }
+  void reset(double time = 0.0);
 
+  // move birth and segment entry time when the generation clock is restarted
+  void shiftTime(double offset);
 
-  struct Chromosome : public EvolutionProcess::Chromosome
+
+  // full state of the vehicle at one point in time.
+  // controllers keep no state of their own, their last actions are the wheel controls of the physics state
+  struct Snapshot
   {
-    Chromosome(Vehicle* v, float* _avgDrivenDistance) : vehicle(v), avgDrivenDistance(_avgDrivenDistance) { readGenesFromVehicle(); }
+    BulletInterface::VehicleState physics;
+
+    int bestSegment;
+    int curSegment;
+    int travelDir;
+    int curLap;
+    float bestDistance;
+    float curDistance;
+    unsigned char alive;
+
+    // simulated time since birth and since entering the current segment, clock times are rebased on restore
+    double age;
+    double segmentAge;
+
+    std::vector<btVector3> sensorStart;
+    std::vector<btVector3> sensorEnd;
+    std::vector<btScalar> sensorDist;
+  };
 
-    void crossover(const EvolutionProcess::Chromosome* other, float prob, EvolutionProcess::Chromosome* resultA, EvolutionProcess::Chromosome* resultB) const;
+  void saveSnapshot(Snapshot* snapshot, BulletInterface* bullet, double time) const;
 
-    void mutate(float prob);
+  // the snapshot may be taken from another vehicle, e.g. to branch rollouts of many genomes from one state
+  void restoreSnapshot(const Snapshot& snapshot, BulletInterface* bullet, double time);
+
+
+  // gene vector of the neural network weights, handed to the optimizer
+  struct Chromosome
+  {
+    Chromosome(Vehicle* v) : vehicle(v) { readGenesFromVehicle(); }
 
-    float fitness() const;
+    // hash of gene vector, used as key of the fitness cache
+    size_t hash() const;
 
 
     void readGenesFromVehicle();
@@ -102,10 +136,6 @@ public:
 
     Vehicle* vehicle;
     std::vector<float> genes;
-
-    float* avgDrivenDistance;
-
-    static float mutationMaxChange;
   };
 
 
@@ -133,14 +163,22 @@ private:
 
   void initSensors(INIReader* settings);
 
+  void addSensor(const btVector3& start, const btVector3& end);
+
 
 private:
   
   btRaycastVehicle* m_vehicle;
   VehicleController* m_controller;
 
+  VehicleStateStore* m_states;
+  int m_slot;
+
   std::vector<Sensor> m_sensors;
 
+  // max distance of any sensor point to chassis origin
+  btScalar m_sensorReach;
+
   NeuralNetwork* m_neuralNetwork;
 
 
@@ -155,19 +193,6 @@ private:
   btScalar m_engineForceFwdMax;
   btScalar m_engineForceRevMax;
   btScalar m_brakeMax;
-
-
-  // performance on track
-  int m_bestSegment;
-  int m_curSegment;
-  double m_curSegmentEntryTime;
-  int m_travelDir; // -1 : reverse, 0 : stop, 1 : forward
-  float m_bestDistance;
-  float m_curDistance;
-  int m_curLap;
-
-  bool m_alive;
-  double m_birthTime;
 };
 
 
@@ -191,7 +216,16 @@ class VehicleControllerUser : public VehicleController, public UserInputControll
 public:
   VehicleControllerUser(Vehicle* vehicle, Application* app);
 
+  void update(double dt);
+
   void keyEvent(GLFWwindow* wnd, int key, int scancode, int action, int mods);
+
+private:
+
+  // key events arrive on the window thread, update applies them on the simulation thread
+  std::atomic<float> m_steering;
+  std::atomic<float> m_engineForce;
+  std::atomic<float> m_brake;
 };
 
 
@@ -0,0 +1,43 @@
+#include "VehicleStateStore.h"
+
+#include <iostream>
+
+
+VehicleStateStore::VehicleStateStore()
+  : m_numSensors(-1)
+{
+}
+
+VehicleStateStore::~VehicleStateStore()
+{
+}
+
+int VehicleStateStore::add(int numSensors)
+{
+  if (m_numSensors < 0)
+    m_numSensors = numSensors;
+  else if (m_numSensors != numSensors)
+    std::cerr << "error: vehicles must have the same number of sensors" << std::endl;
+
+  int slot = size();
+
+  position.push_back(btVector3(0.0f, 0.0f, 0.0f));
+  velocity.push_back(btVector3(0.0f, 0.0f, 0.0f));
+
+  sensorStart.resize(sensorStart.size() + m_numSensors, btVector3(0.0f, 0.0f, 0.0f));
+  sensorEnd.resize(sensorEnd.size() + m_numSensors, btVector3(0.0f, 0.0f, 0.0f));
+  sensorDist.resize(sensorDist.size() + m_numSensors, 0.0f);
+
+  bestSegment.push_back(0);
+  curSegment.push_back(0);
+  curSegmentEntryTime.push_back(0.0);
+  travelDir.push_back(0);
+  bestDistance.push_back(0.0f);
+  curDistance.push_back(0.0f);
+  curLap.push_back(0);
+
+  alive.push_back(1);
+  birthTime.push_back(0.0);
+
+  return slot;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <btBulletDynamicsCommon.h>
+
+#include <vector>
+
+
+// Per vehicle simulation state in structure of arrays layout.
+// Each Vehicle owns one slot, passes over all vehicles (kill checks, controllers, rendering)
+// read the arrays directly instead of going through the Vehicle objects.
+// Slots are handed out in creation order and never released, so references into the arrays stay valid
+// once all vehicles are created.
+class VehicleStateStore
+{
+public:
+
+  VehicleStateStore();
+  virtual ~VehicleStateStore();
+
+
+  // add vehicle with given number of distance sensors, returns slot
+  int add(int numSensors);
+
+  int size() const { return static_cast<int>(alive.size()); }
+
+  // all vehicles share the sensor configuration,
+  // sensor k of vehicle i is at index i * numSensors() + k
+  int numSensors() const { return m_numSensors; }
+  int sensorIndex(int slot, int k) const { return slot * m_numSensors + k; }
+
+  // chassis origin and linear velocity, copied from bullet in Vehicle::update
+  std::vector<btVector3> position;
+  std::vector<btVector3> velocity;
+
+  // world space sensor rays and measured distance
+  std::vector<btVector3> sensorStart;
+  std::vector<btVector3> sensorEnd;
+  std::vector<btScalar> sensorDist;
+
+  // performance on track
+  std::vector<int> bestSegment;
+  std::vector<int> curSegment;
+  std::vector<double> curSegmentEntryTime;
+  std::vector<int> travelDir; // -1 : reverse, 0 : stop, 1 : forward
+  std::vector<float> bestDistance;
+  std::vector<float> curDistance;
+  std::vector<int> curLap;
+
+  std::vector<unsigned char> alive;
+  std::vector<double> birthTime;
+
+private:
+
+  int m_numSensors;
+};
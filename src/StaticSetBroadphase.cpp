@@ -0,0 +1,204 @@
+#include "StaticSetBroadphase.h"
+
+#include <BulletCollision/BroadphaseCollision/btOverlappingPairCache.h>
+#include <LinearMath/btAabbUtil2.h>
+
+#include <iostream>
+
+
+StaticSetBroadphase::StaticSetBroadphase()
+  : m_pairCache(0), m_nextUid(1)
+{
+  m_pairCache = new btHashedOverlappingPairCache();
+}
+
+StaticSetBroadphase::~StaticSetBroadphase()
+{
+  // proxies of collision objects that were never removed from the world
+  for (size_t i = 0; i < m_dynamicProxies.size(); ++i)
+    delete m_dynamicProxies[i];
+
+  struct DeleteLeaf : btDbvt::ICollide
+  {
+    void Process(const btDbvtNode* leaf) { delete static_cast<Proxy*>(leaf->data); }
+  } deleteLeaf;
+
+  if (m_staticTree.m_root)
+    m_staticTree.enumLeaves(m_staticTree.m_root, deleteLeaf);
+
+  delete m_pairCache;
+}
+
+btBroadphaseProxy* StaticSetBroadphase::createProxy(const btVector3& aabbMin, const btVector3& aabbMax, int shapeType, void* userPtr,
+  int collisionFilterGroup, int collisionFilterMask, btDispatcher* dispatcher)
+{
+  Proxy* proxy = new Proxy(aabbMin, aabbMax, userPtr, collisionFilterGroup, collisionFilterMask);
+  proxy->m_uniqueId = m_nextUid++;
+
+  if (isStatic(collisionFilterGroup))
+    proxy->leaf = m_staticTree.insert(btDbvtVolume::FromMM(aabbMin, aabbMax), proxy);
+  else
+  {
+    proxy->leaf = m_dynamicTree.insert(btDbvtVolume::FromMM(aabbMin, aabbMax), proxy);
+    proxy->index = static_cast<int>(m_dynamicProxies.size());
+    m_dynamicProxies.push_back(proxy);
+  }
+
+  return proxy;
+}
+
+void StaticSetBroadphase::destroyProxy(btBroadphaseProxy* proxy, btDispatcher* dispatcher)
+{
+  Proxy* p = static_cast<Proxy*>(proxy);
+
+  m_pairCache->removeOverlappingPairsContainingProxy(p, dispatcher);
+
+  if (p->index < 0)
+    m_staticTree.remove(p->leaf);
+  else
+  {
+    m_dynamicTree.remove(p->leaf);
+
+    // swap with last
+    Proxy* last = m_dynamicProxies.back();
+    m_dynamicProxies[p->index] = last;
+    last->index = p->index;
+    m_dynamicProxies.pop_back();
+  }
+
+  delete p;
+}
+
+void StaticSetBroadphase::setAabb(btBroadphaseProxy* proxy, const btVector3& aabbMin, const btVector3& aabbMax, btDispatcher* dispatcher)
+{
+  Proxy* p = static_cast<Proxy*>(proxy);
+
+  btDbvtVolume volume = btDbvtVolume::FromMM(aabbMin, aabbMax);
+
+  if (p->index < 0)
+    m_staticTree.update(p->leaf, volume);
+  else
+  {
+    // the leaf is only moved once the bounds leave its enlarged volume,
+    // which is extended in the direction of motion (same prediction as btDbvtBroadphase)
+    btVector3 delta = aabbMin - p->m_aabbMin;
+    btVector3 velocity = (p->m_aabbMax - p->m_aabbMin) * btScalar(0.25);
+    for (int k = 0; k < 3; ++k)
+    {
+      if (delta[k] < 0.0f)
+        velocity[k] = -velocity[k];
+    }
+
+    m_dynamicTree.update(p->leaf, volume, velocity, btScalar(0.05));
+  }
+
+  p->m_aabbMin = aabbMin;
+  p->m_aabbMax = aabbMax;
+}
+
+void StaticSetBroadphase::getAabb(btBroadphaseProxy* proxy, btVector3& aabbMin, btVector3& aabbMax) const
+{
+  aabbMin = proxy->m_aabbMin;
+  aabbMax = proxy->m_aabbMax;
+}
+
+void StaticSetBroadphase::rayTest(const btVector3& rayFrom, const btVector3& rayTo, btBroadphaseRayCallback& rayCallback,
+  const btVector3& aabbMin, const btVector3& aabbMax)
+{
+  struct RayCollide : btDbvt::ICollide
+  {
+    RayCollide(btBroadphaseRayCallback& callback) : m_callback(callback) {}
+
+    void Process(const btDbvtNode* leaf) { m_callback.process(static_cast<Proxy*>(leaf->data)); }
+
+    btBroadphaseRayCallback& m_callback;
+  } collide(rayCallback);
+
+  m_staticTree.rayTestInternal(m_staticTree.m_root, rayFrom, rayTo, rayCallback.m_rayDirectionInverse, rayCallback.m_signs,
+    rayCallback.m_lambda_max, aabbMin, aabbMax, m_rayStack, collide);
+
+  m_dynamicTree.rayTestInternal(m_dynamicTree.m_root, rayFrom, rayTo, rayCallback.m_rayDirectionInverse, rayCallback.m_signs,
+    rayCallback.m_lambda_max, aabbMin, aabbMax, m_rayStack, collide);
+}
+
+void StaticSetBroadphase::aabbTest(const btVector3& aabbMin, const btVector3& aabbMax, btBroadphaseAabbCallback& callback)
+{
+  struct AabbCollide : btDbvt::ICollide
+  {
+    AabbCollide(btBroadphaseAabbCallback& callback) : m_callback(callback) {}
+
+    void Process(const btDbvtNode* leaf) { m_callback.process(static_cast<Proxy*>(leaf->data)); }
+
+    btBroadphaseAabbCallback& m_callback;
+  } collide(callback);
+
+  btDbvtVolume volume = btDbvtVolume::FromMM(aabbMin, aabbMax);
+
+  m_staticTree.collideTV(m_staticTree.m_root, volume, collide);
+  m_dynamicTree.collideTV(m_dynamicTree.m_root, volume, collide);
+}
+
+void StaticSetBroadphase::calculateOverlappingPairs(btDispatcher* dispatcher)
+{
+  // drop pairs whose bounds separated since last step
+  struct RemoveSeparated : btOverlapCallback
+  {
+    bool processOverlap(btBroadphasePair& pair)
+    {
+      return !TestAabbAgainstAabb2(pair.m_pProxy0->m_aabbMin, pair.m_pProxy0->m_aabbMax, pair.m_pProxy1->m_aabbMin, pair.m_pProxy1->m_aabbMax);
+    }
+  } removeSeparated;
+
+  m_pairCache->processAllOverlappingPairs(&removeSeparated, dispatcher);
+
+  // keep the query tree balanced as leaves move
+  m_dynamicTree.optimizeIncremental(1);
+
+  // query every dynamic proxy against the static tree, filtering is done by the pair cache
+  struct AddPairs : btDbvt::ICollide
+  {
+    AddPairs(btOverlappingPairCache* cache) : m_cache(cache), m_proxy(0) {}
+
+    void Process(const btDbvtNode* leaf)
+    {
+      // existing pairs are returned unchanged
+      m_cache->addOverlappingPair(m_proxy, static_cast<Proxy*>(leaf->data));
+    }
+
+    btOverlappingPairCache* m_cache;
+    Proxy* m_proxy;
+  } addPairs(m_pairCache);
+
+  if (!m_staticTree.m_root)
+    return;
+
+  for (size_t i = 0; i < m_dynamicProxies.size(); ++i)
+  {
+    addPairs.m_proxy = m_dynamicProxies[i];
+    m_staticTree.collideTV(m_staticTree.m_root, btDbvtVolume::FromMM(addPairs.m_proxy->m_aabbMin, addPairs.m_proxy->m_aabbMax), addPairs);
+  }
+}
+
+void StaticSetBroadphase::getBroadphaseAabb(btVector3& aabbMin, btVector3& aabbMax) const
+{
+  aabbMin = btVector3(BT_LARGE_FLOAT, BT_LARGE_FLOAT, BT_LARGE_FLOAT);
+  aabbMax = -aabbMin;
+
+  if (m_staticTree.m_root)
+  {
+    aabbMin = m_staticTree.m_root->volume.Mins();
+    aabbMax = m_staticTree.m_root->volume.Maxs();
+  }
+
+  for (size_t i = 0; i < m_dynamicProxies.size(); ++i)
+  {
+    aabbMin.setMin(m_dynamicProxies[i]->m_aabbMin);
+    aabbMax.setMax(m_dynamicProxies[i]->m_aabbMax);
+  }
+}
+
+void StaticSetBroadphase::printStats()
+{
+  std::cout << "StaticSetBroadphase: " << m_staticTree.m_leaves << " static, " << m_dynamicProxies.size() << " dynamic proxies, "
+    << m_pairCache->getNumOverlappingPairs() << " pairs" << std::endl;
+}
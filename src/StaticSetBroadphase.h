@@ -0,0 +1,69 @@
+#pragma once
+
+#include <btBulletDynamicsCommon.h>
+#include <BulletCollision/BroadphaseCollision/btDbvt.h>
+
+#include <vector>
+
+
+// Broadphase for worlds where dynamic bodies only interact with static geometry.
+// Proxies in the static filter group are kept in an aabb tree, all other proxies in a flat list.
+// Pairs are only created between a dynamic and a static proxy, dynamic-dynamic pairs are never reported.
+// Cost per step is linear in the number of dynamic proxies.
+// Ray and aabb queries also need the dynamic proxies, for those they are kept in a second tree
+// with slightly enlarged bounds like the dynamic set of btDbvtBroadphase.
+class StaticSetBroadphase : public btBroadphaseInterface
+{
+public:
+
+  StaticSetBroadphase();
+  virtual ~StaticSetBroadphase();
+
+
+  virtual btBroadphaseProxy* createProxy(const btVector3& aabbMin, const btVector3& aabbMax, int shapeType, void* userPtr,
+    int collisionFilterGroup, int collisionFilterMask, btDispatcher* dispatcher);
+  virtual void destroyProxy(btBroadphaseProxy* proxy, btDispatcher* dispatcher);
+  virtual void setAabb(btBroadphaseProxy* proxy, const btVector3& aabbMin, const btVector3& aabbMax, btDispatcher* dispatcher);
+  virtual void getAabb(btBroadphaseProxy* proxy, btVector3& aabbMin, btVector3& aabbMax) const;
+
+  virtual void rayTest(const btVector3& rayFrom, const btVector3& rayTo, btBroadphaseRayCallback& rayCallback,
+    const btVector3& aabbMin = btVector3(0, 0, 0), const btVector3& aabbMax = btVector3(0, 0, 0));
+  virtual void aabbTest(const btVector3& aabbMin, const btVector3& aabbMax, btBroadphaseAabbCallback& callback);
+
+  virtual void calculateOverlappingPairs(btDispatcher* dispatcher);
+
+  virtual btOverlappingPairCache* getOverlappingPairCache() { return m_pairCache; }
+  virtual const btOverlappingPairCache* getOverlappingPairCache() const { return m_pairCache; }
+
+  virtual void getBroadphaseAabb(btVector3& aabbMin, btVector3& aabbMax) const;
+
+  virtual void printStats();
+
+private:
+
+  struct Proxy : public btBroadphaseProxy
+  {
+    Proxy(const btVector3& aabbMin, const btVector3& aabbMax, void* userPtr, int collisionFilterGroup, int collisionFilterMask)
+      : btBroadphaseProxy(aabbMin, aabbMax, userPtr, collisionFilterGroup, collisionFilterMask), leaf(0), index(-1) {}
+
+    // node in static or dynamic tree, position in dynamic list
+    btDbvtNode* leaf;
+    int index;
+  };
+
+  static bool isStatic(int collisionFilterGroup) { return (collisionFilterGroup & btBroadphaseProxy::StaticFilter) != 0; }
+
+private:
+
+  btOverlappingPairCache* m_pairCache;
+
+  btDbvt m_staticTree;
+  std::vector<Proxy*> m_dynamicProxies;
+
+  // dynamic proxies for ray and aabb queries only
+  btDbvt m_dynamicTree;
+
+  btAlignedObjectArray<const btDbvtNode*> m_rayStack;
+
+  int m_nextUid;
+};
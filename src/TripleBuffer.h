@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+
+
+// Lock free handover of the latest value from one producer thread to one consumer thread.
+// The producer fills back() and publishes it, the consumer acquires the newest published value and reads front().
+// Neither side ever waits, values published in between two acquires are skipped.
+template <typename T>
+class TripleBuffer
+{
+public:
+
+  TripleBuffer() : m_back(0), m_shared(1), m_front(2) {}
+
+
+  // producer
+  T& back() { return m_slots[m_back]; }
+
+  // hand back() to the consumer, the producer continues with the slot released last by the consumer
+  void publish() { m_back = m_shared.exchange(m_back | Fresh) & Index; }
+
+
+  // consumer: switch front() to the newest published value, returns false if there is none since the last call
+  bool acquire()
+  {
+    if (!(m_shared.load() & Fresh))
+      return false;
+
+    m_front = m_shared.exchange(m_front) & Index;
+    return true;
+  }
+
+  const T& front() const { return m_slots[m_front]; }
+
+private:
+
+  // shared slot index with flag for not yet acquired values
+  enum { Index = 3, Fresh = 4 };
+
+  T m_slots[3];
+
+  int m_back;
+  std::atomic<int> m_shared;
+  int m_front;
+};
@@ -0,0 +1,87 @@
+#include "TweakVars.h"
+
+#include <cstring>
+#include <iostream>
+
+
+TweakVars::~TweakVars()
+{
+  for (size_t i = 0; i < m_vars.size(); ++i)
+    delete m_vars[i];
+}
+
+TweakVars::Var* TweakVars::add(TwType type, void* var)
+{
+  size_t size = 0;
+  switch (type)
+  {
+  case TW_TYPE_BOOLCPP: size = sizeof(bool); break;
+  case TW_TYPE_INT32: size = sizeof(int); break;
+  case TW_TYPE_FLOAT: size = sizeof(float); break;
+  case TW_TYPE_DOUBLE: size = sizeof(double); break;
+  default:
+    std::cerr << "error: TweakVars type " << type << " not supported" << std::endl;
+    return 0;
+  }
+
+  Var* v = new Var;
+  v->owner = this;
+  v->var = var;
+  v->size = size;
+  v->modified = false;
+  std::memcpy(v->shadow, var, size);
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_vars.push_back(v);
+
+  return v;
+}
+
+void TweakVars::addRW(TwBar* bar, const char* name, TwType type, void* var, const char* def)
+{
+  Var* v = add(type, var);
+  if (v)
+    TwAddVarCB(bar, name, type, setCallback, getCallback, v, def);
+}
+
+void TweakVars::addRO(TwBar* bar, const char* name, TwType type, const void* var, const char* def)
+{
+  // never written back, sync() only reads var
+  Var* v = add(type, const_cast<void*>(var));
+  if (v)
+    TwAddVarCB(bar, name, type, NULL, getCallback, v, def);
+}
+
+void TweakVars::sync()
+{
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  for (size_t i = 0; i < m_vars.size(); ++i)
+  {
+    Var* v = m_vars[i];
+
+    if (v->modified)
+      std::memcpy(v->var, v->shadow, v->size);
+    else
+      std::memcpy(v->shadow, v->var, v->size);
+
+    v->modified = false;
+  }
+}
+
+void TW_CALL TweakVars::setCallback(const void* value, void* clientData)
+{
+  Var* v = static_cast<Var*>(clientData);
+
+  std::lock_guard<std::mutex> lock(v->owner->m_mutex);
+  std::memcpy(v->shadow, value, v->size);
+  v->modified = true;
+}
+
+void TW_CALL TweakVars::getCallback(void* value, void* clientData)
+{
+  Var* v = static_cast<Var*>(clientData);
+
+  std::lock_guard<std::mutex> lock(v->owner->m_mutex);
+  std::memcpy(value, v->shadow, v->size);
+}
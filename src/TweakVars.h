@@ -0,0 +1,50 @@
+#pragma once
+
+#include <AntTweakBar.h>
+
+#include <mutex>
+#include <vector>
+
+
+// Tweak bar variables of state owned by another thread than the window thread.
+// The tweak bar reads and writes a shadow copy of each variable under a lock,
+// the owning thread calls sync() between updates: edits made in the bar are copied to the variables,
+// otherwise the current values are copied to the shadows for display.
+// Supported types: TW_TYPE_BOOLCPP, TW_TYPE_INT32, TW_TYPE_FLOAT, TW_TYPE_DOUBLE
+class TweakVars
+{
+public:
+
+  TweakVars() {}
+  ~TweakVars();
+
+
+  // same parameters as TwAddVarRW and TwAddVarRO, var has to stay valid for the lifetime of the bar
+  void addRW(TwBar* bar, const char* name, TwType type, void* var, const char* def);
+  void addRO(TwBar* bar, const char* name, TwType type, const void* var, const char* def);
+
+  // exchange values with the tweak bar, called by the owning thread
+  void sync();
+
+private:
+
+  struct Var
+  {
+    TweakVars* owner;
+    void* var;
+    size_t size;
+    char shadow[8];
+    bool modified;
+  };
+
+  Var* add(TwType type, void* var);
+
+  static void TW_CALL setCallback(const void* value, void* clientData);
+  static void TW_CALL getCallback(void* value, void* clientData);
+
+private:
+
+  std::vector<Var*> m_vars;
+
+  std::mutex m_mutex;
+};
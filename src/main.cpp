@@ -1,11 +1,20 @@
 
 #include "DeepLearningCarApp.h"
 
+#include <string>
 
-int main(void)
+
+int main(int argc, char** argv)
 {
   DeepLearningCarApp* app = new DeepLearningCarApp();
 
+  // --view <name> : watch a training process that shares its frames under name, see [simulation] sharedMemory
+  for (int i = 1; i + 1 < argc; ++i)
+  {
+    if (std::string(argv[i]) == "--view")
+      app->viewer(argv[i + 1]);
+  }
+
   app->init();
 
   app->exec();